@@ -1,5 +1,7 @@
 #include "MainWindow.hpp"
 #include "../utils/NetworkUtils.hpp"
+#include "../utils/QrCode.hpp"
+#include "../server/Trace.hpp"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QGroupBox>
@@ -7,9 +9,16 @@
 #include <QSettings>
 #include <QDesktopServices>
 #include <QUrl>
+#include <QStandardPaths>
+#include <QFile>
+#include <QHeaderView>
+#include <QImage>
+#include <QPixmap>
+#include <algorithm>
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), m_server(std::make_unique<Server::HttpServer>()), m_qrDialog(nullptr), m_qrLabel(nullptr) {
+    : QMainWindow(parent), m_server(std::make_unique<Server::HttpServer>()), m_qrDialog(nullptr), m_qrLabel(nullptr),
+      m_lastTotalBytes(0) {
     setupUi();
     
     // Load Settings
@@ -20,20 +29,19 @@ MainWindow::MainWindow(QWidget *parent)
     }
     m_portInput->setText(settings.value("port", "4142").toString());
     m_passwordInput->setText(settings.value("password", "").toString());
-
-    m_netManager = new QNetworkAccessManager(this);
-    connect(m_netManager, &QNetworkAccessManager::finished, this, &MainWindow::onQrImageLoaded);
+    m_httpsCheck->setChecked(settings.value("https", false).toBool());
 
     // Set up logging callback
     m_server->setLogCallback([this](const std::string& msg) {
         QMetaObject::invokeMethod(this, "appendLog", Qt::QueuedConnection, 
                                   Q_ARG(QString, QString::fromStdString(msg)));
     });
-    
-    m_server->setClientCountCallback([this](int count) {
-        QMetaObject::invokeMethod(this, "updateClientCount", Qt::QueuedConnection, 
-                                  Q_ARG(int, count));
-    });
+
+    // The dashboard polls a lock-free server snapshot instead of getting a
+    // queued callback per connect/disconnect
+    m_statsTimer = new QTimer(this);
+    m_statsTimer->setInterval(500);
+    connect(m_statsTimer, &QTimer::timeout, this, &MainWindow::refreshDashboard);
 }
 
 MainWindow::~MainWindow() {
@@ -42,6 +50,7 @@ MainWindow::~MainWindow() {
     settings.setValue("lastPath", m_pathInput->text());
     settings.setValue("port", m_portInput->text());
     settings.setValue("password", m_passwordInput->text());
+    settings.setValue("https", m_httpsCheck->isChecked());
 
     if (m_server->isRunning()) {
         m_server->stop();
@@ -77,6 +86,9 @@ void MainWindow::setupUi() {
     m_passwordInput->setEchoMode(QLineEdit::PasswordEchoOnEdit);
     formLayout->addRow("Password:", m_passwordInput);
 
+    m_httpsCheck = new QCheckBox("Use HTTPS (self-signed certificate)", this);
+    formLayout->addRow("Security:", m_httpsCheck);
+
     m_statusLabel = new QLabel("Stopped", this);
     m_statusLabel->setStyleSheet("color: red; font-weight: bold;");
     formLayout->addRow("Status:", m_statusLabel);
@@ -89,6 +101,19 @@ void MainWindow::setupUi() {
     m_urlCombo->setPlaceholderText("Start server to see URLs");
     formLayout->addRow("Local URL:", m_urlCombo);
 
+    QHBoxLayout *traceLayout = new QHBoxLayout();
+    m_traceCombo = new QComboBox(this);
+    m_traceCombo->addItem("Off", 0);
+    m_traceCombo->addItem("1 in 100 connections", 100);
+    m_traceCombo->addItem("1 in 10 connections", 10);
+    m_traceCombo->addItem("Every connection", 1);
+    connect(m_traceCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onTraceRateChanged);
+    m_saveTraceBtn = new QPushButton("Save Trace...", this);
+    connect(m_saveTraceBtn, &QPushButton::clicked, this, &MainWindow::onSaveTraceClicked);
+    traceLayout->addWidget(m_traceCombo);
+    traceLayout->addWidget(m_saveTraceBtn);
+    formLayout->addRow("Tracing:", traceLayout);
+
     mainLayout->addWidget(configGroup);
 
     // Controls
@@ -106,15 +131,30 @@ void MainWindow::setupUi() {
     btnLayout->addWidget(m_qrBtn);
     mainLayout->addLayout(btnLayout);
 
+    // Live connections
+    QGroupBox *connGroup = new QGroupBox("Active Connections", this);
+    QVBoxLayout *connLayout = new QVBoxLayout(connGroup);
+    m_throughputGraph = new ThroughputGraph(this);
+    connLayout->addWidget(m_throughputGraph);
+    m_connTable = new QTableWidget(0, 8, this);
+    m_connTable->setHorizontalHeaderLabels({"Client", "Path", "Offset", "Sent", "Rate", "RTT", "Send Buffer", "Age"});
+    m_connTable->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_connTable->horizontalHeader()->setSectionResizeMode(1, QHeaderView::Stretch);
+    m_connTable->verticalHeader()->setVisible(false);
+    m_connTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_connTable->setSelectionMode(QAbstractItemView::NoSelection);
+    connLayout->addWidget(m_connTable);
+    mainLayout->addWidget(connGroup, 2);
+
     // Logs
     QGroupBox *logGroup = new QGroupBox("Server Logs", this);
     QVBoxLayout *logLayout = new QVBoxLayout(logGroup);
     m_logOutput = new QTextEdit(this);
     m_logOutput->setReadOnly(true);
     logLayout->addWidget(m_logOutput);
-    mainLayout->addWidget(logGroup);
+    mainLayout->addWidget(logGroup, 1);
 
-    resize(600, 400);
+    resize(800, 700);
     setWindowTitle("LAN Video Streamer (C++ Qt6)");
 }
 
@@ -143,6 +183,40 @@ void MainWindow::onStartStopClicked() {
         
         std::string password = m_passwordInput->text().toStdString();
 
+        if (m_httpsCheck->isChecked()) {
+            // Certificate is generated on first use and reused afterwards
+            QString certDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+            std::vector<std::string> altNames;
+            for (const QString& ip : Utils::getAllIPAddresses()) altNames.push_back(ip.toStdString());
+            m_server->setTlsCertificate((certDir + "/server.crt").toStdString(),
+                                        (certDir + "/server.key").toStdString(), altNames);
+        } else {
+            m_server->setTlsCertificate("", "");
+        }
+
+        // Listener tuning has no widgets: it is read from (and written back to,
+        // so the keys are easy to find) the settings file on every start
+        QSettings settings("CppVideoLan", "Server");
+        int listeners = settings.value("listeners", 0).toInt(); // 0: one per core
+        int backlog = settings.value("listenBacklog", 1024).toInt();
+        bool cpuAffinity = settings.value("cpuAffinity", false).toBool();
+        int drainTimeoutMs = settings.value("drainTimeoutMs", 5000).toInt();
+        settings.setValue("listeners", listeners);
+        settings.setValue("listenBacklog", backlog);
+        settings.setValue("cpuAffinity", cpuAffinity);
+        settings.setValue("drainTimeoutMs", drainTimeoutMs);
+        m_server->setListenerCount(listeners);
+        m_server->setListenBacklog(backlog);
+        m_server->setCpuAffinity(cpuAffinity);
+        m_server->setDrainTimeout(drainTimeoutMs);
+
+        // Thumbnails survive restarts, so a gallery is only decoded once
+        m_server->setThumbnailCacheDir(
+            (QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails").toStdString());
+
+        // Benchmark capture for localwaves-replay; off unless the variable is set
+        m_server->setCaptureFile(qEnvironmentVariable("LOCALWAVES_CAPTURE").toStdString());
+
         if (m_server->start(port, path.toStdString(), password)) {
             updateServerStatus();
         } else {
@@ -162,15 +236,24 @@ void MainWindow::updateServerStatus() {
         int port = m_portInput->text().toInt();
         if (port <= 0) port = 4142;
 
+        QString scheme = m_server->isTlsEnabled() ? "https" : "http";
         for(const QString& ip : ips) {
-            m_urlCombo->addItem(QString("http://%1:%2").arg(ip).arg(port));
+            m_urlCombo->addItem(QString("%1://%2:%3").arg(scheme).arg(ip).arg(port));
         }
         
         m_pathInput->setEnabled(false);
         m_portInput->setEnabled(false);
         m_passwordInput->setEnabled(false);
+        m_httpsCheck->setEnabled(false);
         m_browseBtn->setEnabled(false);
         m_qrBtn->setEnabled(true);
+
+        // The byte counter runs across restarts, so the first sample must not count earlier runs
+        m_lastTotalBytes = m_server->snapshot().totalBytesSent;
+        m_lastConnBytes.clear();
+        m_throughputGraph->clear();
+        m_statsClock.start();
+        m_statsTimer->start();
     } else {
         m_startStopBtn->setText("Start Server");
         m_statusLabel->setText("Stopped");
@@ -182,19 +265,94 @@ void MainWindow::updateServerStatus() {
         m_pathInput->setEnabled(true);
         m_portInput->setEnabled(true);
         m_passwordInput->setEnabled(true);
+        m_httpsCheck->setEnabled(true);
         m_browseBtn->setEnabled(true);
         m_qrBtn->setEnabled(false);
+
+        m_statsTimer->stop();
+        m_connTable->setRowCount(0);
+        m_clientCountLabel->setText("0");
     }
 }
 
-void MainWindow::updateClientCount(int count) {
-    m_clientCountLabel->setText(QString::number(count));
+static QString formatBytes(double bytes) {
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 4) { bytes /= 1024.0; ++unit; }
+    return QString("%1 %2").arg(bytes, 0, 'f', unit == 0 ? 0 : 1).arg(units[unit]);
+}
+
+void MainWindow::refreshDashboard() {
+    Server::ServerSnapshot snapshot = m_server->snapshot();
+    double seconds = m_statsClock.restart() / 1000.0;
+    if (seconds <= 0) seconds = m_statsTimer->interval() / 1000.0;
+
+    QString clients = QString::number(snapshot.activeConnections);
+    if (snapshot.rejectedRequests > 0) clients += QString(" (%1 turned away)").arg(snapshot.rejectedRequests);
+    m_clientCountLabel->setText(clients);
+
+    double delta = snapshot.totalBytesSent > m_lastTotalBytes ? double(snapshot.totalBytesSent - m_lastTotalBytes) : 0.0;
+    m_throughputGraph->addSample(delta / seconds);
+    m_lastTotalBytes = snapshot.totalBytesSent;
+
+    // Busiest connections first, so whoever saturates the link is on top
+    QHash<quint64, quint64> currentBytes;
+    std::vector<std::pair<double, const Server::ConnectionSnapshot*>> rows;
+    for (const auto& conn : snapshot.connections) {
+        quint64 previous = m_lastConnBytes.value(conn.id, 0);
+        double rate = conn.bytesSent > previous ? (conn.bytesSent - previous) / seconds : 0.0;
+        rows.emplace_back(rate, &conn);
+        currentBytes.insert(conn.id, conn.bytesSent);
+    }
+    m_lastConnBytes = currentBytes;
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    m_connTable->setRowCount(int(rows.size()));
+    for (int row = 0; row < int(rows.size()); ++row) {
+        const Server::ConnectionSnapshot& conn = *rows[row].second;
+        const QStringList cells = {
+            QString::fromStdString(conn.clientIp),
+            QString::fromStdString(conn.path),
+            formatBytes(double(conn.offset)),
+            formatBytes(double(conn.bytesSent)),
+            QString("%1 Mbit/s").arg(rows[row].first * 8 / 1e6, 0, 'f', 1),
+            conn.rttUs ? QString("%1 ms").arg(conn.rttUs / 1000.0, 0, 'f', 1) : QString("-"),
+            conn.sendBuffer ? formatBytes(conn.sendBuffer) + (conn.pacingRate ? " (paced)" : "") : QString("-"),
+            QString("%1 s").arg(conn.ageSeconds, 0, 'f', 0)
+        };
+        for (int col = 0; col < cells.size(); ++col) {
+            QTableWidgetItem *item = m_connTable->item(row, col);
+            if (!item) {
+                item = new QTableWidgetItem();
+                m_connTable->setItem(row, col, item);
+            }
+            item->setText(cells[col]);
+        }
+    }
 }
 
 void MainWindow::appendLog(const QString& message) {
     m_logOutput->append(message);
 }
 
+void MainWindow::onTraceRateChanged(int index) {
+    Server::Tracer::setSampleEvery(m_traceCombo->itemData(index).toUInt());
+}
+
+void MainWindow::onSaveTraceClicked() {
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Trace", QDir::homePath() + "/localwaves-trace.json",
+                                                    "Chrome Trace (*.json)");
+    if (fileName.isEmpty()) return;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        QMessageBox::warning(this, "Error", "Could not write " + fileName);
+        return;
+    }
+    file.write(QByteArray::fromStdString(Server::Tracer::dumpChromeJson()));
+    appendLog("Trace saved to " + fileName + " (open in ui.perfetto.dev or chrome://tracing)");
+}
+
 void MainWindow::onShowQrClicked() {
     QString urlStr = m_urlCombo->currentText();
     if (urlStr.isEmpty()) return;
@@ -204,33 +362,32 @@ void MainWindow::onShowQrClicked() {
         m_qrDialog = new QDialog(this);
         m_qrDialog->setWindowTitle("Scan QR Code");
         QVBoxLayout *layout = new QVBoxLayout(m_qrDialog);
-        m_qrLabel = new QLabel("Loading QR Code...", m_qrDialog);
+        m_qrLabel = new QLabel(m_qrDialog);
         m_qrLabel->setAlignment(Qt::AlignCenter);
         m_qrLabel->setMinimumSize(300, 300);
         layout->addWidget(m_qrLabel);
     }
     
-    m_qrLabel->setText("Loading...");
-    m_qrDialog->show();
-    m_qrDialog->raise();
-    m_qrDialog->activateWindow();
-
-    QString qrApiUrl = "http://api.qrserver.com/v1/create-qr-code/?size=300x300&data=" + urlStr;
-    m_netManager->get(QNetworkRequest(QUrl(qrApiUrl)));
-}
-
-void MainWindow::onQrImageLoaded(QNetworkReply *reply) {
-    if (reply->error() == QNetworkReply::NoError) {
-        QByteArray data = reply->readAll();
-        QPixmap pixmap;
-        pixmap.loadFromData(data);
-        if (m_qrLabel) {
-            m_qrLabel->setPixmap(pixmap);
+    // Encoded locally: works on offline LANs and keeps the address off third-party servers
+    Utils::QrCode qr = Utils::QrCode::encode(urlStr.toStdString(), Utils::QrCode::Ecc::Medium);
+    if (qr.isValid()) {
+        const int quietZone = 4;
+        const int modules = qr.size() + 2 * quietZone;
+        QImage image(modules, modules, QImage::Format_RGB32);
+        image.fill(Qt::white);
+        for (int y = 0; y < qr.size(); ++y) {
+            for (int x = 0; x < qr.size(); ++x) {
+                if (qr.module(x, y)) image.setPixel(x + quietZone, y + quietZone, qRgb(0, 0, 0));
+            }
         }
+        // Whole pixels per module keep the edges sharp
+        int scale = std::max(1, 300 / modules);
+        m_qrLabel->setPixmap(QPixmap::fromImage(image.scaled(modules * scale, modules * scale, Qt::IgnoreAspectRatio, Qt::FastTransformation)));
     } else {
-        if (m_qrLabel) {
-            m_qrLabel->setText("Error loading QR Code.\nCheck internet connection.");
-        }
+        m_qrLabel->setText("URL too long for a QR Code.");
     }
-    reply->deleteLater();
+
+    m_qrDialog->show();
+    m_qrDialog->raise();
+    m_qrDialog->activateWindow();
 }
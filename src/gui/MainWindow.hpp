@@ -6,13 +6,17 @@
 #include <QPushButton>
 #include <QLabel>
 #include <QComboBox>
+#include <QCheckBox>
 #include <QVBoxLayout>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
 #include <QDialog>
 #include <QLabel>
+#include <QTableWidget>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
 #include <memory>
 #include "../server/HttpServer.hpp"
+#include "ThroughputGraph.hpp"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -25,28 +29,39 @@ private slots:
     void onBrowseClicked();
     void onStartStopClicked();
     void onShowQrClicked();
-    void onQrImageLoaded(QNetworkReply *reply);
     void appendLog(const QString& message);
+    void onTraceRateChanged(int index);
+    void onSaveTraceClicked();
+    void refreshDashboard();
 
 private:
     void setupUi();
     void updateServerStatus();
-    void updateClientCount(int count);
 
     QLineEdit *m_pathInput;
     QLineEdit *m_portInput;
     QLineEdit *m_passwordInput;
+    QCheckBox *m_httpsCheck;
     QPushButton *m_browseBtn;
     QPushButton *m_startStopBtn;
     QPushButton *m_qrBtn;
-    
-    QNetworkAccessManager *m_netManager;
+
     QDialog *m_qrDialog;
     QLabel *m_qrLabel;
     QTextEdit *m_logOutput;
     QLabel *m_statusLabel;
     QLabel *m_clientCountLabel;
     QComboBox *m_urlCombo;
+    QComboBox *m_traceCombo;
+    QTableWidget *m_connTable;
+    ThroughputGraph *m_throughputGraph;
+
+    // Dashboard polling: rates are derived from byte deltas between snapshots
+    QTimer *m_statsTimer;
+    QElapsedTimer m_statsClock;
+    quint64 m_lastTotalBytes;
+    QHash<quint64, quint64> m_lastConnBytes;
+    QPushButton *m_saveTraceBtn;
 
     std::unique_ptr<Server::HttpServer> m_server;
 };
@@ -0,0 +1,52 @@
+#include "ThroughputGraph.hpp"
+#include <QPainter>
+#include <QPainterPath>
+#include <algorithm>
+
+ThroughputGraph::ThroughputGraph(QWidget *parent)
+    : QWidget(parent), m_capacity(240) {
+    setMinimumHeight(90);
+}
+
+void ThroughputGraph::addSample(double bytesPerSecond) {
+    m_samples.append(std::max(0.0, bytesPerSecond));
+    if (m_samples.size() > m_capacity) m_samples.remove(0, m_samples.size() - m_capacity);
+    update();
+}
+
+void ThroughputGraph::clear() {
+    m_samples.clear();
+    update();
+}
+
+void ThroughputGraph::paintEvent(QPaintEvent *) {
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.fillRect(rect(), palette().base());
+
+    double peak = 1.0;
+    for (double v : m_samples) peak = std::max(peak, v);
+
+    const QRectF area = QRectF(rect()).adjusted(4, 18, -4, -4);
+    const double step = area.width() / std::max(1, m_capacity - 1);
+
+    if (m_samples.size() > 1) {
+        QPainterPath line;
+        // Newest sample on the right edge
+        double x = area.right() - step * (m_samples.size() - 1);
+        for (int i = 0; i < m_samples.size(); ++i, x += step) {
+            QPointF p(x, area.bottom() - area.height() * m_samples[i] / peak);
+            if (i == 0) line.moveTo(p);
+            else line.lineTo(p);
+        }
+        painter.setPen(QPen(QColor(0, 120, 212), 2));
+        painter.drawPath(line);
+    }
+
+    double current = m_samples.isEmpty() ? 0.0 : m_samples.last();
+    painter.setPen(palette().text().color());
+    painter.drawText(rect().adjusted(6, 2, -6, 0), Qt::AlignLeft | Qt::AlignTop,
+                     QString("Throughput: %1 Mbit/s (peak %2)")
+                         .arg(current * 8 / 1e6, 0, 'f', 1)
+                         .arg(peak * 8 / 1e6, 0, 'f', 1));
+}
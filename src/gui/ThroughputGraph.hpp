@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QWidget>
+#include <QVector>
+
+// Scrolling line graph of aggregate server throughput (bytes/s), one sample per poll
+class ThroughputGraph : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit ThroughputGraph(QWidget *parent = nullptr);
+
+    void addSample(double bytesPerSecond);
+    void clear();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QVector<double> m_samples;
+    int m_capacity;
+};
@@ -0,0 +1,100 @@
+#include "AdmissionControl.hpp"
+#include <algorithm>
+
+namespace Server {
+
+AdmissionControl::Ticket& AdmissionControl::Ticket::operator=(Ticket&& other) noexcept {
+    if (this != &other) {
+        if (m_owner) m_owner->release(m_class);
+        m_owner = other.m_owner;
+        m_class = other.m_class;
+        other.m_owner = nullptr;
+    }
+    return *this;
+}
+
+AdmissionControl::Ticket::~Ticket() {
+    if (m_owner) m_owner->release(m_class);
+}
+
+AdmissionControl::AdmissionControl() : m_rejected(0) {
+    auto now = std::chrono::steady_clock::now();
+    for (Queue& queue : m_queues) queue.intervalStart = now;
+}
+
+void AdmissionControl::setLimits(const Limits& limits) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limits = limits;
+    m_limits.streams = std::max(1, m_limits.streams);
+    m_limits.streamReserve = std::clamp(m_limits.streamReserve, 0, m_limits.streams - 1);
+    m_limits.listings = std::max(1, m_limits.listings);
+    m_limits.uploads = std::max(1, m_limits.uploads);
+    m_limits.events = std::max(0, m_limits.events);
+    m_limits.connections = std::max(1, m_limits.connections);
+    for (Queue& queue : m_queues) queue.cv.notify_all(); // Raised limits admit waiters now
+}
+
+AdmissionControl::Limits AdmissionControl::limits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limits;
+}
+
+int AdmissionControl::limitFor(Class cls, bool resumedStream) const {
+    switch (cls) {
+        case Class::Stream: return resumedStream ? m_limits.streams : m_limits.streams - m_limits.streamReserve;
+        case Class::Listing: return m_limits.listings;
+        case Class::Upload: return m_limits.uploads;
+        case Class::Events: return m_limits.events;
+        default: return 1;
+    }
+}
+
+void AdmissionControl::recordDelay(Queue& queue, std::chrono::steady_clock::time_point now,
+                                   std::chrono::steady_clock::duration delay) {
+    // Called with m_mutex held. At the end of each interval the smallest
+    // delay seen decides whether the queue is standing (CoDel's criterion).
+    queue.minDelay = std::min(queue.minDelay, delay);
+    if (now - queue.intervalStart >= kInterval) {
+        queue.overloaded = queue.minDelay > kTarget;
+        queue.minDelay = std::chrono::steady_clock::duration::max();
+        queue.intervalStart = now;
+    }
+}
+
+AdmissionControl::Ticket AdmissionControl::admit(Class cls, bool resumedStream) {
+    auto arrived = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Queue& queue = m_queues[(int)cls];
+
+    if (queue.active < limitFor(cls, resumedStream)) {
+        queue.active++;
+        recordDelay(queue, arrived, std::chrono::steady_clock::duration::zero());
+        return Ticket(this, cls);
+    }
+
+    // Resumed streams always get the full interval: they are the ones to protect
+    auto patience = queue.overloaded && !resumedStream ? kTarget : kInterval;
+    queue.waiting++;
+    bool admitted = queue.cv.wait_until(lock, arrived + patience, [&] {
+        return queue.active < limitFor(cls, resumedStream);
+    });
+    queue.waiting--;
+    auto now = std::chrono::steady_clock::now();
+    recordDelay(queue, now, now - arrived);
+    if (!admitted) {
+        countRejection();
+        return Ticket();
+    }
+    queue.active++;
+    return Ticket(this, cls);
+}
+
+void AdmissionControl::release(Class cls) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Queue& queue = m_queues[(int)cls];
+    queue.active--;
+    // notify_all: a resumed stream may fit in a slot a new stream cannot use
+    if (queue.waiting > 0) queue.cv.notify_all();
+}
+
+}
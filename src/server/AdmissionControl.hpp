@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace Server {
+
+// Per-class slot limits with a short, bounded wait.
+//
+// Each class (streams, listings, uploads, live listing updates) has a number
+// of slots, held for the whole request. A request that finds them full waits
+// for a slot to free up, then gets 503 with Retry-After. The wait is CoDel's
+// rule applied to that slot turnover: while some waiter of the last interval
+// (100ms) got a slot quickly, waiters may queue for a whole interval; once
+// even the fastest waited longer than the target (20ms), they give up after
+// the target. For listings, thumbnails and subtitles a slot is held for
+// milliseconds, so this sheds a standing queue early. Streams, uploads and
+// event streams hold theirs for as long as the transfer lasts, so for them
+// it is simply a concurrency cap with a 20-100ms grace period, not a delay
+// controller.
+//
+// A share of the stream slots is reserved for resumed streams (Range past
+// the start), which is what a viewer's player sends while watching and
+// seeking. New viewers are turned away before current ones stutter.
+class AdmissionControl {
+public:
+    enum class Class { Stream, Listing, Upload, Events, Count };
+
+    struct Limits {
+        int streams = 64;
+        int streamReserve = 16;  // Of streams, only for resumed streams
+        int listings = 16;
+        int uploads = 4;
+        int events = 32;         // Open listing tabs with live updates; each holds a thread
+        int connections = 512;   // Beyond this, accept() answers 503 without a thread
+    };
+
+    static constexpr std::chrono::milliseconds kTarget{20};
+    static constexpr std::chrono::milliseconds kInterval{100};
+    static constexpr int kRetryAfterSeconds = 2;
+
+    // Holds a slot until destroyed; false when the request was shed
+    class Ticket {
+    public:
+        Ticket() : m_owner(nullptr), m_class(Class::Stream) {}
+        Ticket(Ticket&& other) noexcept : m_owner(other.m_owner), m_class(other.m_class) { other.m_owner = nullptr; }
+        Ticket& operator=(Ticket&& other) noexcept;
+        ~Ticket();
+        explicit operator bool() const { return m_owner != nullptr; }
+
+    private:
+        friend class AdmissionControl;
+        Ticket(AdmissionControl* owner, Class cls) : m_owner(owner), m_class(cls) {}
+        AdmissionControl* m_owner;
+        Class m_class;
+    };
+
+    AdmissionControl();
+
+    void setLimits(const Limits& limits);
+    Limits limits() const;
+
+    // Blocks for at most kInterval (kTarget while overloaded)
+    Ticket admit(Class cls, bool resumedStream = false);
+
+    uint64_t rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+    void countRejection() { m_rejected.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    struct Queue {
+        std::condition_variable cv;
+        int active = 0;
+        int waiting = 0;
+        bool overloaded = false;
+        std::chrono::steady_clock::time_point intervalStart;
+        std::chrono::steady_clock::duration minDelay = std::chrono::steady_clock::duration::max();
+    };
+
+    int limitFor(Class cls, bool resumedStream) const;
+    void recordDelay(Queue& queue, std::chrono::steady_clock::time_point now, std::chrono::steady_clock::duration delay);
+    void release(Class cls);
+
+    mutable std::mutex m_mutex;
+    Limits m_limits;
+    Queue m_queues[(int)Class::Count];
+    std::atomic<uint64_t> m_rejected;
+};
+
+}
@@ -0,0 +1,183 @@
+#include "Compression.hpp"
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef LOCALWAVES_HAS_ZLIB
+    #include <zlib.h>
+#endif
+#ifdef LOCALWAVES_HAS_BROTLI
+    #include <brotli/encode.h>
+#endif
+
+namespace Server {
+
+const char* encodingName(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip: return "gzip";
+        case ContentEncoding::Brotli: return "br";
+        default: return "";
+    }
+}
+
+const char* encodingSuffix(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip: return ".gz";
+        case ContentEncoding::Brotli: return ".br";
+        default: return "";
+    }
+}
+
+std::vector<ContentEncoding> acceptedEncodings(const std::string& acceptEncoding) {
+    double gzipQ = -1, brQ = -1, anyQ = -1;
+
+    std::istringstream tokens(acceptEncoding);
+    std::string token;
+    while (std::getline(tokens, token, ',')) {
+        std::string name = token.substr(0, token.find(';'));
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+        double q = 1.0;
+        size_t qPos = token.find("q=");
+        if (qPos != std::string::npos) q = std::atof(token.c_str() + qPos + 2);
+
+        if (name == "gzip" || name == "x-gzip") gzipQ = q;
+        else if (name == "br") brQ = q;
+        else if (name == "*") anyQ = q;
+    }
+    if (gzipQ < 0) gzipQ = anyQ;
+    if (brQ < 0) brQ = anyQ;
+
+    std::vector<ContentEncoding> result;
+    if (brQ > 0 && brQ >= gzipQ) result.push_back(ContentEncoding::Brotli);
+    if (gzipQ > 0) result.push_back(ContentEncoding::Gzip);
+    if (brQ > 0 && brQ < gzipQ) result.push_back(ContentEncoding::Brotli);
+    return result;
+}
+
+ContentEncoding negotiateEncoding(const std::string& acceptEncoding) {
+    for (ContentEncoding encoding : acceptedEncodings(acceptEncoding)) {
+        (void)encoding; // Unused when built without zlib and brotli
+#ifdef LOCALWAVES_HAS_BROTLI
+        if (encoding == ContentEncoding::Brotli) return encoding;
+#endif
+#ifdef LOCALWAVES_HAS_ZLIB
+        if (encoding == ContentEncoding::Gzip) return encoding;
+#endif
+    }
+    return ContentEncoding::Identity;
+}
+
+bool isCompressibleMime(const std::string& mimeType) {
+    return mimeType.rfind("text/", 0) == 0
+        || mimeType == "application/json"
+        || mimeType == "application/javascript"
+        || mimeType == "application/xml"
+        || mimeType == "application/x-subrip"
+        || mimeType == "image/svg+xml";
+}
+
+bool compressBody(const std::string& input, ContentEncoding encoding, std::string& output) {
+    switch (encoding) {
+#ifdef LOCALWAVES_HAS_ZLIB
+    case ContentEncoding::Gzip: {
+        z_stream zs = {};
+        // windowBits 15 + 16 selects the gzip wrapper; level 6 is the usual speed/ratio point
+        if (deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+        output.resize(deflateBound(&zs, (uLong)input.size()));
+        zs.next_in = (Bytef*)input.data();
+        zs.avail_in = (uInt)input.size();
+        zs.next_out = (Bytef*)&output[0];
+        zs.avail_out = (uInt)output.size();
+        int rc = deflate(&zs, Z_FINISH);
+        output.resize(zs.total_out);
+        deflateEnd(&zs);
+        return rc == Z_STREAM_END;
+    }
+#endif
+#ifdef LOCALWAVES_HAS_BROTLI
+    case ContentEncoding::Brotli: {
+        size_t size = BrotliEncoderMaxCompressedSize(input.size());
+        if (size == 0) return false;
+        output.resize(size);
+        // Quality 5 compresses about as fast as gzip -6 and still beats it on HTML
+        if (!BrotliEncoderCompress(5, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                                   input.size(), (const uint8_t*)input.data(),
+                                   &size, (uint8_t*)&output[0])) {
+            return false;
+        }
+        output.resize(size);
+        return true;
+    }
+#endif
+    default:
+        (void)input;
+        (void)output;
+        return false;
+    }
+}
+
+CompressionCache::CompressionCache(size_t maxBytes) : m_bytes(0), m_maxBytes(maxBytes) {}
+
+std::shared_ptr<const std::string> CompressionCache::get(const std::string& validator, ContentEncoding encoding,
+                                                         const std::string& body) {
+    if (encoding == ContentEncoding::Identity) return nullptr;
+    std::string key = std::string(encodingName(encoding)) + '|' + validator;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            if (it->second->data->empty()) return nullptr; // Known to be incompressible
+            return it->second->data;
+        }
+    }
+
+    // Compress outside the lock; two threads racing on the same miss is harmless
+    auto compressed = std::make_shared<std::string>();
+    if (!compressBody(body, encoding, *compressed)) return nullptr;
+
+    // Not worth a Content-Encoding header (tiny or already compressed data):
+    // cache an empty marker so the next request skips the attempt
+    if (compressed->size() + 64 >= body.size()) compressed->clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_index.find(key) == m_index.end() && compressed->size() + key.size() <= m_maxBytes) {
+        m_lru.push_front(Entry{key, compressed});
+        m_index[key] = m_lru.begin();
+        m_bytes += compressed->size() + key.size();
+        while (m_bytes > m_maxBytes && !m_lru.empty()) {
+            m_bytes -= m_lru.back().data->size() + m_lru.back().key.size();
+            m_index.erase(m_lru.back().key);
+            m_lru.pop_back();
+        }
+    }
+    if (compressed->empty()) return nullptr;
+    return compressed;
+}
+
+std::shared_ptr<const std::string> CompressionCache::lookup(const std::string& validator, ContentEncoding encoding, bool& found) {
+    found = false;
+    if (encoding == ContentEncoding::Identity) return nullptr;
+    std::string key = std::string(encodingName(encoding)) + '|' + validator;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end()) return nullptr;
+    found = true;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    if (it->second->data->empty()) return nullptr;
+    return it->second->data;
+}
+
+void CompressionCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lru.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace Server {
+
+enum class ContentEncoding { Identity, Gzip, Brotli };
+
+// Header token ("gzip", "br"), empty for Identity
+const char* encodingName(ContentEncoding encoding);
+
+// File suffix of a precompressed sibling (".gz", ".br"), empty for Identity
+const char* encodingSuffix(ContentEncoding encoding);
+
+// Encodings an Accept-Encoding header value allows, most preferred first
+// (by q-value, brotli before gzip on ties). Identity is never listed.
+std::vector<ContentEncoding> acceptedEncodings(const std::string& acceptEncoding);
+
+// Best accepted encoding this build can produce on the fly, else Identity
+ContentEncoding negotiateEncoding(const std::string& acceptEncoding);
+
+// Text-like types that typically shrink 5-10x
+bool isCompressibleMime(const std::string& mimeType);
+
+// Compresses input; returns false when the encoder is unavailable or failed
+bool compressBody(const std::string& input, ContentEncoding encoding, std::string& output);
+
+// LRU cache of compressed variants, keyed by a content validator
+// (path + mtime + size for files, a body hash for generated pages)
+class CompressionCache {
+public:
+    explicit CompressionCache(size_t maxBytes = 32 * 1024 * 1024);
+
+    // Returns the compressed variant, compressing and caching body on a miss.
+    // body is only read on a miss. Returns nullptr if compression is not worth it.
+    std::shared_ptr<const std::string> get(const std::string& validator, ContentEncoding encoding,
+                                           const std::string& body);
+
+    // Cache probe without compressing. found is true also for entries known
+    // to be incompressible, which return nullptr.
+    std::shared_ptr<const std::string> lookup(const std::string& validator, ContentEncoding encoding, bool& found);
+
+    void clear();
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const std::string> data;
+    };
+
+    std::mutex m_mutex;
+    std::list<Entry> m_lru; // Front = most recently used
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t m_bytes;
+    size_t m_maxBytes;
+};
+
+}
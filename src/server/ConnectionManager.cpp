@@ -0,0 +1,97 @@
+#include "ConnectionManager.hpp"
+
+#ifndef _WIN32
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+namespace Server {
+
+ConnectionManager::ConnectionManager() : m_nextId(1), m_draining(false) {}
+
+uint64_t ConnectionManager::add(Socket socket) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_draining) return 0;
+    uint64_t id = m_nextId++;
+    m_entries[id] = Entry{socket, true};
+    return id;
+}
+
+void ConnectionManager::remove(uint64_t id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.erase(id);
+    if (m_entries.empty()) m_emptyCv.notify_all();
+}
+
+void ConnectionManager::closeSocket(uint64_t id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(id);
+    if (it == m_entries.end() || it->second.socket == kClosed) return;
+#ifdef _WIN32
+    ::closesocket(it->second.socket);
+#else
+    ::close(it->second.socket);
+#endif
+    it->second.socket = kClosed;
+}
+
+bool ConnectionManager::markIdle(uint64_t id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_draining) return false;
+    auto it = m_entries.find(id);
+    if (it != m_entries.end()) it->second.busy = false;
+    return true;
+}
+
+void ConnectionManager::markBusy(uint64_t id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(id);
+    if (it != m_entries.end()) it->second.busy = true;
+}
+
+bool ConnectionManager::isDraining() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_draining;
+}
+
+int ConnectionManager::count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_entries.size());
+}
+
+void ConnectionManager::beginDrain() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_draining = true;
+    for (auto& [id, entry] : m_entries) {
+        // Wakes the recv() of keep-alive connections waiting for a next request
+        if (!entry.busy) shutdownSocket(entry.socket);
+    }
+}
+
+bool ConnectionManager::waitForDrain(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_emptyCv.wait_for(lock, timeout, [this] { return m_entries.empty(); });
+}
+
+void ConnectionManager::abortAndWait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto& [id, entry] : m_entries) shutdownSocket(entry.socket);
+    // Threads still reference the server, so this wait must not time out
+    m_emptyCv.wait(lock, [this] { return m_entries.empty(); });
+}
+
+void ConnectionManager::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_draining = false;
+}
+
+void ConnectionManager::shutdownSocket(Socket socket) {
+    if (socket == kClosed) return;
+#ifdef _WIN32
+    ::shutdown(socket, SD_BOTH);
+#else
+    ::shutdown(socket, SHUT_RDWR);
+#endif
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+#endif
+
+namespace Server {
+
+// Tracks live client connections so stop() can drain them: idle keep-alive
+// sockets are closed right away, busy ones get to finish their response.
+class ConnectionManager {
+public:
+#ifdef _WIN32
+    using Socket = SOCKET;
+#else
+    using Socket = int;
+#endif
+
+    ConnectionManager();
+
+    // Returns 0 when the server is already draining (caller must close the socket)
+    uint64_t add(Socket socket);
+    void remove(uint64_t id);
+    // Closes the connection's socket under the lock, so a drain never shuts
+    // down a descriptor number the OS has already handed to a new client
+    void closeSocket(uint64_t id);
+
+    // Connection is about to wait for the next request.
+    // Returns false when draining: the connection should close instead.
+    bool markIdle(uint64_t id);
+    void markBusy(uint64_t id);
+
+    bool isDraining() const;
+    int count() const;
+
+    // Stop accepting and shut down idle connections
+    void beginDrain();
+    // Waits for busy connections to finish; false on timeout
+    bool waitForDrain(std::chrono::milliseconds timeout);
+    // Forces every remaining socket closed and waits for the threads to exit
+    void abortAndWait();
+    // Leaves draining mode so the server can be started again
+    void reset();
+
+private:
+    struct Entry {
+        Socket socket;
+        bool busy;
+    };
+
+    static constexpr Socket kClosed = static_cast<Socket>(-1);
+
+    static void shutdownSocket(Socket socket);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_emptyCv;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    uint64_t m_nextId;
+    bool m_draining;
+};
+
+}
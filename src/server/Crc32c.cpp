@@ -0,0 +1,191 @@
+#include "Crc32c.hpp"
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <nmmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+    #define LOCALWAVES_CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    #include <arm_acle.h>
+    #define LOCALWAVES_CRC32C_ARM
+#endif
+
+#ifdef __linux__
+    #include <sys/stat.h>
+    #include <sys/xattr.h>
+#endif
+
+namespace Server {
+
+namespace {
+
+constexpr uint32_t kPolynomial = 0x82F63B78; // Castagnoli, reflected
+constexpr const char* kAttribute = "user.localwaves.crc32c";
+
+struct Tables {
+    uint32_t t[8][256];
+};
+
+constexpr Tables makeTables() {
+    Tables tables{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (kPolynomial & (0u - (crc & 1)));
+        tables.t[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int k = 1; k < 8; ++k) tables.t[k][i] = (tables.t[k - 1][i] >> 8) ^ tables.t[0][tables.t[k - 1][i] & 0xFF];
+    }
+    return tables;
+}
+
+constexpr Tables kTables = makeTables();
+
+#ifdef LOCALWAVES_CRC32C_SSE42
+#ifndef _MSC_VER
+__attribute__((target("sse4.2")))
+#endif
+uint32_t extendHardware(uint32_t crc, const unsigned char* p, size_t length) {
+    uint64_t c = crc;
+    for (; length >= 8; p += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+    }
+    uint32_t c32 = (uint32_t)c;
+    for (; length > 0; ++p, --length) c32 = _mm_crc32_u8(c32, *p);
+    return c32;
+}
+
+bool detectHardware() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#elif defined(LOCALWAVES_CRC32C_ARM)
+uint32_t extendHardware(uint32_t crc, const unsigned char* p, size_t length) {
+    for (; length >= 8; p += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+    }
+    for (; length > 0; ++p, --length) crc = __crc32cb(crc, *p);
+    return crc;
+}
+
+bool detectHardware() { return true; } // Guaranteed by __ARM_FEATURE_CRC32
+#endif
+
+#ifdef __linux__
+std::string stamp(const struct stat& st, uint32_t crc) {
+    char buf[80];
+    std::snprintf(buf, sizeof(buf), "%08x %llu %lld.%09ld", crc, (unsigned long long)st.st_size,
+                  (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+    return buf;
+}
+#endif
+
+}
+
+uint32_t Crc32c::extendSoftware(uint32_t crc, const void* data, size_t length) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const auto& t = kTables.t;
+    crc = ~crc;
+    for (; length >= 8; p += 8, length -= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; length > 0; ++p, --length) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    return ~crc;
+}
+
+bool Crc32c::hardwareAccelerated() {
+#if defined(LOCALWAVES_CRC32C_SSE42) || defined(LOCALWAVES_CRC32C_ARM)
+    static const bool available = detectHardware();
+    return available;
+#else
+    return false;
+#endif
+}
+
+uint32_t Crc32c::extend(uint32_t crc, const void* data, size_t length) {
+#if defined(LOCALWAVES_CRC32C_SSE42) || defined(LOCALWAVES_CRC32C_ARM)
+    if (hardwareAccelerated()) return ~extendHardware(~crc, static_cast<const unsigned char*>(data), length);
+#endif
+    return extendSoftware(crc, data, length);
+}
+
+std::string Crc32c::toHex(uint32_t crc) {
+    char buf[9];
+    std::snprintf(buf, sizeof(buf), "%08x", crc);
+    return buf;
+}
+
+bool Crc32c::parse(const std::string& text, uint32_t& crc) {
+    if (text.size() != 8) return false;
+    uint32_t value = 0;
+    if (text.compare(6, 2, "==") == 0) {
+        // Base64 of the 4 big-endian bytes, as in x-goog-hash / x-amz-checksum-crc32c
+        static const char* kAlphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; ++i) {
+            const char* pos = text[i] ? std::strchr(kAlphabet, text[i]) : nullptr;
+            if (!pos) return false;
+            bits = bits << 6 | (uint64_t)(pos - kAlphabet);
+        }
+        value = (uint32_t)(bits >> 4); // 36 bits carry 32
+    } else {
+        for (char c : text) {
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) return false;
+            value = value << 4 | (uint32_t)digit;
+        }
+    }
+    crc = value;
+    return true;
+}
+
+bool Crc32c::store(const std::filesystem::path& path, uint32_t crc) {
+#ifdef __linux__
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    std::string value = stamp(st, crc);
+    return setxattr(path.c_str(), kAttribute, value.data(), value.size(), 0) == 0;
+#else
+    (void)path;
+    (void)crc;
+    return false;
+#endif
+}
+
+bool Crc32c::load(const std::filesystem::path& path, uint32_t& crc) {
+#ifdef __linux__
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    char value[80];
+    ssize_t length = getxattr(path.c_str(), kAttribute, value, sizeof(value) - 1);
+    if (length < 9) return false;
+    value[length] = '\0';
+    uint32_t stored = 0;
+    if (!parse(std::string(value, 8), stored)) return false;
+    // Any write since store() changes size or mtime and retires the checksum
+    if (stamp(st, stored) != value) return false;
+    crc = stored;
+    return true;
+#else
+    (void)path;
+    (void)crc;
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,301 @@
+#include "DirectoryWatcher.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+
+#ifdef __linux__
+    #include <poll.h>
+    #include <sys/eventfd.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Server {
+
+namespace {
+
+constexpr size_t kMaxPending = 256; // Slow subscriber: drop the backlog and ask for a reload
+
+}
+
+DirectoryWatcher::DirectoryWatcher() : m_inotifyFd(-1), m_wakeFd(-1), m_running(false) {}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    stop();
+}
+
+bool DirectoryWatcher::start(const std::string& rootDir, Renderer renderer) {
+    stop();
+#ifdef __linux__
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_inotifyFd < 0 || m_wakeFd < 0) {
+        stop();
+        return false;
+    }
+    m_rootDir = rootDir;
+    m_renderer = std::move(renderer);
+    m_running = true;
+    m_thread = std::thread(&DirectoryWatcher::run, this);
+    return true;
+#else
+    (void)rootDir;
+    (void)renderer;
+    return false;
+#endif
+}
+
+void DirectoryWatcher::stop() {
+#ifdef __linux__
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        uint64_t one = 1;
+        (void)!write(m_wakeFd, &one, sizeof(one));
+        m_thread.join();
+    }
+    if (m_inotifyFd >= 0) close(m_inotifyFd);
+    if (m_wakeFd >= 0) close(m_wakeFd);
+#endif
+    m_inotifyFd = -1;
+    m_wakeFd = -1;
+    m_running = false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& [watch, entry] : m_watches) closeWatch(entry, nullptr);
+    m_watches.clear();
+}
+
+std::shared_ptr<DirectoryWatcher::Subscription> DirectoryWatcher::subscribe(const std::string& urlPath) {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_running) return nullptr;
+    fs::path dir = fs::path(m_rootDir) / (urlPath == "/" ? "" : urlPath.substr(1));
+    // Same directory, same watch descriptor: inotify dedupes for us
+    int watch = inotify_add_watch(m_inotifyFd, dir.c_str(),
+                                  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (watch < 0) return nullptr;
+
+    auto subscription = std::make_shared<Subscription>();
+    subscription->watch = watch;
+    Watch& entry = m_watches[watch];
+    entry.urlPath = urlPath;
+    entry.subscribers.push_back(subscription);
+    return subscription;
+#else
+    (void)urlPath;
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<DirectoryWatcher::Subscription> DirectoryWatcher::followFile(const std::string& filePath) {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_running) return nullptr;
+    int watch = inotify_add_watch(m_inotifyFd, filePath.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (watch < 0) return nullptr;
+
+    auto subscription = std::make_shared<Subscription>();
+    subscription->watch = watch;
+    m_watches[watch].subscribers.push_back(subscription);
+    return subscription;
+#else
+    (void)filePath;
+    return nullptr;
+#endif
+}
+
+void DirectoryWatcher::unsubscribe(const std::shared_ptr<Subscription>& subscription) {
+    if (!subscription) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (subscription->watch < 0) return; // Closed: its number may belong to another path now
+    auto it = m_watches.find(subscription->watch);
+    if (it == m_watches.end()) return;
+    auto& subscribers = it->second.subscribers;
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), subscription), subscribers.end());
+    if (subscribers.empty()) {
+#ifdef __linux__
+        inotify_rm_watch(m_inotifyFd, it->first);
+#endif
+        m_watches.erase(it);
+    }
+}
+
+std::vector<DirectoryWatcher::Message> DirectoryWatcher::wait(Subscription& subscription, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(subscription.mutex);
+    subscription.cv.wait_for(lock, timeout, [&subscription] { return !subscription.pending.empty(); });
+    std::vector<Message> messages(subscription.pending.begin(), subscription.pending.end());
+    subscription.pending.clear();
+    return messages;
+}
+
+bool DirectoryWatcher::isClosed(Subscription& subscription) {
+    std::lock_guard<std::mutex> lock(subscription.mutex);
+    return subscription.closed && subscription.pending.empty();
+}
+
+bool DirectoryWatcher::isWriteClosed(Subscription& subscription) {
+    std::lock_guard<std::mutex> lock(subscription.mutex);
+    return subscription.writeClosed;
+}
+
+std::string DirectoryWatcher::jsonEscape(const std::string& value) {
+    std::string out;
+    out.reserve(value.size() + 8);
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+void DirectoryWatcher::publish(int watch, const char* event, const std::string& json) {
+    // Called with m_mutex held
+    auto it = m_watches.find(watch);
+    if (it == m_watches.end()) return;
+    auto message = std::make_shared<const std::string>(std::string("event: ") + event + "\ndata: " + json + "\n\n");
+    static const Message reload = std::make_shared<const std::string>("event: reload\ndata: {}\n\n");
+
+    for (const auto& subscription : it->second.subscribers) {
+        {
+            std::lock_guard<std::mutex> lock(subscription->mutex);
+            if (subscription->pending.size() >= kMaxPending) {
+                subscription->pending.clear();
+                subscription->pending.push_back(reload);
+            } else if (subscription->pending.empty() || subscription->pending.back() != reload) {
+                subscription->pending.push_back(message);
+            }
+        }
+        subscription->cv.notify_one();
+    }
+}
+
+void DirectoryWatcher::wake(Watch& watch, bool writeClosed) {
+    // Called with m_mutex held. One pending marker is enough: the follower
+    // re-reads the file size, however many writes happened meanwhile
+    static const Message modified = std::make_shared<const std::string>();
+    for (const auto& subscription : watch.subscribers) {
+        {
+            std::lock_guard<std::mutex> lock(subscription->mutex);
+            if (writeClosed) subscription->writeClosed = true;
+            if (!subscription->pending.empty()) continue;
+            subscription->pending.push_back(modified);
+        }
+        subscription->cv.notify_one();
+    }
+}
+
+void DirectoryWatcher::closeWatch(Watch& watch, const Message& last) {
+    // Called with m_mutex held
+    for (const auto& subscription : watch.subscribers) {
+        subscription->watch = -1;
+        {
+            std::lock_guard<std::mutex> lock(subscription->mutex);
+            subscription->closed = true;
+            if (last) subscription->pending.push_back(last);
+        }
+        subscription->cv.notify_one();
+    }
+    watch.subscribers.clear();
+}
+
+void DirectoryWatcher::run() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[16 * 1024];
+    pollfd fds[2] = {{m_inotifyFd, POLLIN, 0}, {m_wakeFd, POLLIN, 0}};
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_running) break;
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        ssize_t length = read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) continue;
+
+        // Collect one batch first so MOVED_FROM/MOVED_TO pairs become renames
+        struct Change {
+            int watch;
+            uint32_t mask;
+            uint32_t cookie;
+            std::string name;
+        };
+        std::vector<Change> changes;
+        for (char* p = buffer; p < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            std::string name = event->len ? std::string(event->name) : std::string();
+            bool fileEvent = event->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED);
+            if (!(event->mask & IN_Q_OVERFLOW) && !fileEvent && (name.empty() || name[0] == '.')) continue; // Hidden, as in the listing
+            changes.push_back(Change{event->wd, event->mask, event->cookie, name});
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < changes.size(); ++i) {
+            Change& change = changes[i];
+            if (change.mask & IN_Q_OVERFLOW) {
+                // Events were lost: every page has to re-fetch
+                for (auto& [watch, entry] : m_watches) publish(watch, "reload", "{}");
+                continue;
+            }
+            auto it = m_watches.find(change.watch);
+            if (it == m_watches.end()) continue;
+            if (change.mask & IN_IGNORED) {
+                // The kernel dropped the watch (file or folder deleted) and may reuse its
+                // number: end the subscriptions rather than leave them pointing at it.
+                // A listing page reloads, a follower re-checks the file and stops.
+                static const Message reload = std::make_shared<const std::string>("event: reload\ndata: {}\n\n");
+                closeWatch(it->second, it->second.urlPath.empty() ? std::make_shared<const std::string>() : reload);
+                m_watches.erase(it);
+                continue;
+            }
+            if (change.mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                wake(it->second, (change.mask & IN_CLOSE_WRITE) != 0);
+                continue;
+            }
+            const std::string& urlPath = it->second.urlPath;
+            bool isDirectory = (change.mask & IN_ISDIR) != 0;
+
+            if (change.mask & IN_MOVED_FROM) {
+                auto to = std::find_if(changes.begin() + i + 1, changes.end(), [&change](const Change& c) {
+                    return (c.mask & IN_MOVED_TO) && c.cookie == change.cookie && c.watch == change.watch;
+                });
+                if (to != changes.end()) {
+                    publish(change.watch, "rename", "{\"from\":\"" + jsonEscape(change.name) + "\",\"name\":\"" +
+                            jsonEscape(to->name) + "\",\"html\":\"" +
+                            jsonEscape(m_renderer(urlPath, to->name, isDirectory)) + "\"}");
+                    to->mask = 0; // Consumed
+                } else {
+                    publish(change.watch, "remove", "{\"name\":\"" + jsonEscape(change.name) + "\"}");
+                }
+            } else if (change.mask & (IN_CREATE | IN_MOVED_TO)) {
+                publish(change.watch, "add", "{\"name\":\"" + jsonEscape(change.name) + "\",\"html\":\"" +
+                        jsonEscape(m_renderer(urlPath, change.name, isDirectory)) + "\"}");
+            } else if (change.mask & IN_DELETE) {
+                publish(change.watch, "remove", "{\"name\":\"" + jsonEscape(change.name) + "\"}");
+            }
+        }
+    }
+#endif
+}
+
+}
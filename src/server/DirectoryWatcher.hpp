@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Server {
+
+// Pushes add/remove/rename events for folders that browsers are viewing.
+//
+// Linux inotify watches only the folders with at least one subscriber. Each
+// change is rendered once (listing HTML fragment included) into a ready
+// Server-Sent Events message, and the same buffer is queued for every
+// subscriber. An open tab costs a few hundred bytes per change, not a
+// re-render of the listing.
+//
+// Single files can be watched too (IN_MODIFY), so a live-follow stream of a
+// recording in progress sleeps until the writer appends instead of polling,
+// and ends as soon as the writer closes the file (IN_CLOSE_WRITE).
+class DirectoryWatcher {
+public:
+    // Listing entry markup for name inside urlPath, as the full page renders it
+    using Renderer = std::function<std::string(const std::string& urlPath, const std::string& name, bool isDirectory)>;
+    using Message = std::shared_ptr<const std::string>;
+
+    struct Subscription {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Message> pending;
+        bool closed = false; // Watch gone (path deleted, or watcher stopped); guarded by mutex
+        bool writeClosed = false; // Followed file: a writer closed it (IN_CLOSE_WRITE); guarded by mutex
+        int watch = -1;      // Guarded by the watcher's mutex; -1 once closed
+    };
+
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    // False where change notification is not available (the page then falls back to reloads)
+    bool start(const std::string& rootDir, Renderer renderer);
+    void stop();
+
+    // urlPath is the folder as it appears in the URL ("/" or "/photos")
+    std::shared_ptr<Subscription> subscribe(const std::string& urlPath);
+    // Wakes the subscription (with an empty "modified" message) whenever the file
+    // is written, closed, moved or deleted
+    std::shared_ptr<Subscription> followFile(const std::string& filePath);
+    void unsubscribe(const std::shared_ptr<Subscription>& subscription);
+
+    // Waits up to timeout for messages; returns what was queued (possibly nothing)
+    static std::vector<Message> wait(Subscription& subscription, std::chrono::milliseconds timeout);
+    // No more messages will come: the subscriber should finish
+    static bool isClosed(Subscription& subscription);
+    // A followed file was closed by its writer since the subscription began
+    static bool isWriteClosed(Subscription& subscription);
+
+private:
+    struct Watch {
+        std::string urlPath; // Empty for a followed file
+        std::vector<std::shared_ptr<Subscription>> subscribers;
+    };
+
+    void run();
+    void publish(int watch, const char* event, const std::string& json);
+    void wake(Watch& watch, bool writeClosed);
+    // Ends every subscription of the watch, with a final message for each
+    void closeWatch(Watch& watch, const Message& last);
+    static std::string jsonEscape(const std::string& value);
+
+    std::mutex m_mutex;
+    std::string m_rootDir;
+    Renderer m_renderer;
+    std::unordered_map<int, Watch> m_watches;
+    int m_inotifyFd;
+    int m_wakeFd;
+    bool m_running;
+    std::thread m_thread;
+};
+
+}
@@ -0,0 +1,205 @@
+#include "DiskScheduler.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+    #include <climits>
+    #include <cstdlib>
+    #include <sys/stat.h>
+    #include <sys/sysmacros.h>
+    #include <unistd.h>
+#endif
+
+namespace Server {
+
+class DiskScheduler::Device {
+public:
+    Device() : m_scratch(kWindow), m_stopping(false), m_thread(&Device::run, this) {}
+
+    ~Device() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    std::future<int64_t> submit(int fd, uint64_t inode, uint64_t offset, size_t length, char* dest) {
+        Request request{fd, offset, length, dest, std::promise<int64_t>()};
+        std::future<int64_t> result = request.done.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.emplace(std::make_pair(inode, offset), std::move(request));
+        }
+        m_cv.notify_one();
+        return result;
+    }
+
+private:
+    struct Request {
+        int fd;
+        uint64_t offset;
+        size_t length;
+        char* dest;
+        std::promise<int64_t> done;
+    };
+    using Key = std::pair<uint64_t, uint64_t>; // (inode, offset)
+
+    void run() {
+        Key head{0, 0};
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) return; // Stopping and drained
+
+            // C-SCAN: next request at or past the head, wrapping to the lowest
+            auto it = m_queue.lower_bound(head);
+            if (it == m_queue.end()) it = m_queue.begin();
+            head = it->first;
+            Request request = std::move(it->second);
+            m_queue.erase(it);
+            lock.unlock();
+
+            request.done.set_value(read(request));
+
+            lock.lock();
+        }
+    }
+
+    int64_t read(const Request& request) {
+#ifdef __linux__
+        char* out = request.dest ? request.dest : m_scratch.data();
+        size_t done = 0;
+        while (done < request.length) {
+            ssize_t n = pread(request.fd, out + done, request.length - done, (off_t)(request.offset + done));
+            if (n < 0) return -1;
+            if (n == 0) break; // EOF: the file shrank
+            done += (size_t)n;
+        }
+        return (int64_t)done;
+#else
+        (void)request;
+        return -1;
+#endif
+    }
+
+    std::vector<char> m_scratch; // Target of page-cache-only reads
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::multimap<Key, Request> m_queue;
+    bool m_stopping;
+    std::thread m_thread;
+};
+
+#ifdef __linux__
+// /sys/dev/block/M:m resolves to the disk, or to a partition under it
+static bool isRotational(dev_t dev) {
+    char link[64];
+    std::snprintf(link, sizeof(link), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+    char resolved[PATH_MAX];
+    if (!realpath(link, resolved)) return false; // Network or virtual filesystem
+
+    std::string dir = resolved;
+    for (int level = 0; level < 2; ++level) {
+        std::ifstream flag(dir + "/queue/rotational");
+        int rotational = 0;
+        if (flag >> rotational) return rotational == 1;
+        dir = dir.substr(0, dir.find_last_of('/'));
+    }
+    return false;
+}
+#endif
+
+DiskScheduler::DiskScheduler() : m_mode(Mode::Auto) {}
+
+DiskScheduler::~DiskScheduler() = default;
+
+void DiskScheduler::setMode(Mode mode) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (mode == m_mode) return;
+    m_mode = mode;
+    // Threads of devices that now bypass stay until shutdown: readers may hold them
+    for (auto it = m_devices.begin(); it != m_devices.end();) {
+        if (!it->second) it = m_devices.erase(it);
+        else ++it;
+    }
+}
+
+DiskScheduler::Device* DiskScheduler::deviceFor(int fd) {
+#ifdef __linux__
+    struct stat st;
+    if (fstat(fd, &st) != 0) return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_mode == Mode::Off) return nullptr;
+    auto it = m_devices.find((uint64_t)st.st_dev);
+    if (it == m_devices.end()) {
+        bool schedule = m_mode == Mode::All || isRotational(st.st_dev);
+        it = m_devices.emplace((uint64_t)st.st_dev, schedule ? std::make_unique<Device>() : nullptr).first;
+    }
+    return it->second.get();
+#else
+    (void)fd;
+    return nullptr;
+#endif
+}
+
+std::future<int64_t> DiskScheduler::submit(Device* device, int fd, uint64_t offset, size_t length, char* dest) {
+    uint64_t inode = 0;
+#ifdef __linux__
+    struct stat st;
+    if (fstat(fd, &st) == 0) inode = (uint64_t)st.st_ino;
+#endif
+    return device->submit(fd, inode, offset, length, dest);
+}
+
+DiskReader::DiskReader(DiskScheduler& scheduler, DiskScheduler::Device* device, int fd,
+                       uint64_t start, uint64_t length, bool intoBuffers)
+    : m_scheduler(scheduler), m_device(device), m_fd(fd), m_next(start), m_end(start + length),
+      m_intoBuffers(intoBuffers), m_current(0), m_pendingOffset(0), m_pendingLength(0) {
+    if (m_intoBuffers) {
+        m_buffers[0].resize(DiskScheduler::kWindow);
+        m_buffers[1].resize(DiskScheduler::kWindow);
+    }
+    queue();
+}
+
+DiskReader::~DiskReader() {
+    if (m_pending.valid()) m_pending.wait();
+}
+
+void DiskReader::queue() {
+    if (m_next >= m_end) return;
+    m_pendingOffset = m_next;
+    m_pendingLength = (size_t)std::min<uint64_t>(DiskScheduler::kWindow, m_end - m_next);
+    char* dest = m_intoBuffers ? m_buffers[m_current].data() : nullptr;
+    m_pending = m_scheduler.submit(m_device, m_fd, m_pendingOffset, m_pendingLength, dest);
+    m_next += m_pendingLength;
+}
+
+bool DiskReader::next(uint64_t& offset, size_t& length, const char*& data) {
+    if (!m_pending.valid()) return false;
+    int64_t got = m_pending.get();
+    if (got <= 0) return false;
+
+    offset = m_pendingOffset;
+    length = (size_t)got;
+    data = m_intoBuffers ? m_buffers[m_current].data() : nullptr;
+    if ((size_t)got < m_pendingLength) {
+        m_next = m_end; // Short read: stop after this window
+        return true;
+    }
+
+    // The other buffer held the window before this one, which the caller has sent
+    m_current ^= 1;
+    queue();
+    return true;
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Server {
+
+// Serialises reads per block device so concurrent streams from one spinning
+// disk stop fighting over the head.
+//
+// Each rotational device gets one I/O thread. Connections queue large
+// windows (4MB) instead of issuing small reads of their own. The thread
+// serves them in C-SCAN order of (inode, offset), which is a cheap stand-in
+// for on-disk position. A seek is then amortised over megabytes instead of
+// one 64KB chunk. SSDs, network filesystems and unknown devices bypass the
+// queue entirely.
+class DiskScheduler {
+public:
+    enum class Mode { Off, Auto, All }; // Auto: rotational devices only
+
+    static constexpr size_t kWindow = 4 * 1024 * 1024;
+
+    class Device;
+
+    DiskScheduler();
+    ~DiskScheduler();
+
+    void setMode(Mode mode);
+
+    // Queue for the device holding fd, or nullptr when reads should go direct
+    Device* deviceFor(int fd);
+
+    // Queues a read of [offset, offset + length). With dest null the data is
+    // only pulled into the page cache (for a following sendfile).
+    // Resolves to the number of bytes read, or -1.
+    std::future<int64_t> submit(Device* device, int fd, uint64_t offset, size_t length, char* dest);
+
+private:
+    std::mutex m_mutex;
+    Mode m_mode;
+    std::map<uint64_t, std::unique_ptr<Device>> m_devices; // By st_dev; null entry = bypass
+};
+
+// Double-buffered sequential read of one file range through a device queue:
+// while the caller sends window N, window N+1 is being read.
+class DiskReader {
+public:
+    // intoBuffers: hand out the bytes (copy path); otherwise only guarantee
+    // that each window is in the page cache (sendfile path)
+    DiskReader(DiskScheduler& scheduler, DiskScheduler::Device* device, int fd,
+               uint64_t start, uint64_t length, bool intoBuffers);
+    ~DiskReader(); // Waits for the read in flight; fd must outlive this
+
+    // Next window: [offset, offset + length), data null in page-cache mode.
+    // False at the end of the range or on a read error.
+    bool next(uint64_t& offset, size_t& length, const char*& data);
+
+private:
+    void queue();
+
+    DiskScheduler& m_scheduler;
+    DiskScheduler::Device* m_device;
+    int m_fd;
+    uint64_t m_next;   // Start of the next window to queue
+    uint64_t m_end;
+    bool m_intoBuffers;
+    std::vector<char> m_buffers[2];
+    int m_current;
+    std::future<int64_t> m_pending;
+    uint64_t m_pendingOffset;
+    size_t m_pendingLength;
+};
+
+}
@@ -1,17 +1,33 @@
 #include "HttpConnection.hpp"
 #include "MimeTypes.hpp"
+#include "ConnectionManager.hpp"
+#include "Trace.hpp"
+#include "ZipStream.hpp"
+#include "ThumbnailCache.hpp"
+#include "DiskScheduler.hpp"
+#include "DirectoryWatcher.hpp"
+#include "Crc32c.hpp"
+#include "Subtitles.hpp"
+#include "AdmissionControl.hpp"
+#include "TrafficCapture.hpp"
+#include "SessionStore.hpp"
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <fstream>
 #include <filesystem>
 #include <cstring>
+#include <cctype>
 #include <cstdio>
+#include <chrono>
+#include <thread>
 
 #ifdef _WIN32
+    #include <ws2tcpip.h>
     #include <mswsock.h>
     #pragma comment(lib, "Mswsock.lib")
 #else
+    #include <arpa/inet.h>
     #include <sys/sendfile.h>
     #include <sys/stat.h>
     #include <fcntl.h>
@@ -24,24 +40,93 @@ namespace fs = std::filesystem;
 
 namespace Server {
 
-HttpConnection::HttpConnection(SocketType socket, const std::string& rootDir, const std::string& password, std::function<void(const std::string&)> logCallback)
-    : m_socket(socket), m_rootDir(rootDir), m_password(password), m_log(logCallback) {
-    
-    // OPTIMIZATION: Enable TCP_NODELAY to disable Nagle's algorithm for lower latency
-    int flag = 1;
-    setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+namespace {
+
+// Per-phase deadlines, enforced by the server's TimerWheel
+constexpr uint32_t kIdleTimeoutMs = 20000;        // Keep-alive wait for the next request
+constexpr uint32_t kHeaderTimeoutMs = 10000;      // First byte to end of headers (and TLS handshake)
+constexpr uint32_t kBodyWindowMs = 10000;         // Uploads must deliver kMinBodyBytes per window
+constexpr int kMinBodyBytes = 16 * 1024;
+constexpr uint32_t kSendStallMs = 30000;          // Response without any progress
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+constexpr int64_t kDiscardBodyBytes = 1024 * 1024; // Unread body read off before an early close
+constexpr uint32_t kLingerMs = 2000;              // Bound on discarding and the lingering close
+
+// Live follow of files still being recorded
+constexpr auto kGrowingWindow = std::chrono::seconds(5); // Written this recently: treat as growing
+constexpr auto kFollowIdle = std::chrono::seconds(10);   // No growth this long: the recording ended
+constexpr auto kFollowPoll = std::chrono::milliseconds(500); // Without inotify
+constexpr auto kRangeWait = std::chrono::seconds(5);     // A range past the end waits this long for data
+
+int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+HttpConnection::HttpConnection(SocketType socket, const ServerContext& context, uint64_t id)
+    : m_socket(socket), m_rootDir(context.rootDir), m_password(context.password), m_log(context.log),
+      m_ctx(context), m_id(id), m_tuner(socket), m_slot(nullptr), m_encoding(ContentEncoding::Identity),
+      m_timedOut(nullptr), m_timerTag(nullptr), m_timerArmedNs(0), m_status(0), m_wireBytes(0) {
+    // TCP_NODELAY and SO_SNDBUF are owned by m_tuner, which adapts them per client
+
+    // Runs on the wheel thread: shutdown() wakes whatever recv/send/sendfile
+    // this thread is blocked in, and the error path unwinds the connection
+    m_timer.onExpire = [this] {
+        m_timedOut.store(m_timer.tag, std::memory_order_relaxed);
+#ifdef _WIN32
+        shutdown(m_socket, SD_BOTH);
+#else
+        shutdown(m_socket, SHUT_RDWR);
+#endif
+    };
+
+    if (m_ctx.stats) {
+        sockaddr_in peer;
+        std::memset(&peer, 0, sizeof(peer));
+#ifdef _WIN32
+        int peerLen = sizeof(peer);
+#else
+        socklen_t peerLen = sizeof(peer);
+#endif
+        char ip[INET_ADDRSTRLEN] = "?";
+        if (getpeername(m_socket, (struct sockaddr*)&peer, &peerLen) == 0) {
+            inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        }
+        m_slot = m_ctx.stats->acquire(m_id, ip);
+    }
+}
 
-    // OPTIMIZATION: Increase Send Buffer Size (SO_SNDBUF)
-    int sendBuff = 1024 * 1024; // 1MB Kernel Buffer
-    setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, (char*)&sendBuff, sizeof(sendBuff));
+bool HttpConnection::isLoopbackPeer() const {
+    sockaddr_in peer;
+    std::memset(&peer, 0, sizeof(peer));
+#ifdef _WIN32
+    int peerLen = sizeof(peer);
+#else
+    socklen_t peerLen = sizeof(peer);
+#endif
+    if (getpeername(m_socket, (struct sockaddr*)&peer, &peerLen) != 0 || peer.sin_family != AF_INET) return false;
+    return (ntohl(peer.sin_addr.s_addr) >> 24) == 127;
 }
 
 HttpConnection::~HttpConnection() {
+    if (m_ctx.timers) m_ctx.timers->cancel(m_timer); // Before the socket number can be reused
+    const char* timedOut = m_timedOut.load(std::memory_order_relaxed);
+    if (timedOut && std::strcmp(timedOut, "idle") != 0 && std::strcmp(timedOut, "linger") != 0) {
+        m_log(std::string("Closed stalled connection (") + timedOut + " timeout)");
+    }
+    if (m_ctx.stats) m_ctx.stats->release(m_slot);
+    m_tls.reset(); // close_notify before the socket goes away
+    if (m_ctx.connections) {
+        m_ctx.connections->closeSocket(m_id);
+    } else {
 #ifdef _WIN32
-    closesocket(m_socket);
+        closesocket(m_socket);
 #else
-    close(m_socket);
+        close(m_socket);
 #endif
+    }
 }
 
 std::string HttpConnection::urlDecode(const std::string& str) {
@@ -66,7 +151,20 @@ std::string HttpConnection::urlDecode(const std::string& str) {
 
 bool HttpConnection::checkAuth(const std::string& request) {
     if (m_password.empty()) return true;
-    if (request.find("Cookie: auth=1") != std::string::npos) return true;
+    if (!m_ctx.sessions) return false;
+    // Cookie: a=1; session=<token>; b=2
+    std::string cookies = getHeader(request, "Cookie");
+    size_t pos = 0;
+    while (pos < cookies.size()) {
+        size_t end = cookies.find(';', pos);
+        if (end == std::string::npos) end = cookies.size();
+        size_t start = cookies.find_first_not_of(' ', pos);
+        if (start < end && cookies.compare(start, 8, "session=") == 0 &&
+            m_ctx.sessions->isValid(cookies.substr(start + 8, end - start - 8))) {
+            return true;
+        }
+        pos = end + 1;
+    }
     return false;
 }
 
@@ -87,37 +185,99 @@ void HttpConnection::sendLogin() {
         "<button type='submit'>Unlock</button>"
         "</form></div></body></html>";
     
-    std::ostringstream response;
-    response << "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " << html.length() 
-             << "\r\nConnection: keep-alive\r\n\r\n" << html;
-    sendResponse(response.str());
+    sendText("text/html", html, "login");
 }
 
+struct HttpConnection::CaptureScope {
+    HttpConnection& connection;
+    TrafficCapture* capture;
+    TrafficCapture::Record record;
+    uint64_t wireBytesBefore;
+
+    CaptureScope(HttpConnection& conn, const std::string& method, const std::string& path, const std::string& request)
+        : connection(conn), capture(conn.m_ctx.capture), wireBytesBefore(conn.m_wireBytes) {
+        connection.m_status = 0;
+        if (!capture) return;
+        record.startUs = capture->nowUs();
+        record.connection = connection.m_id;
+        record.method = TrafficCapture::methodFromString(method);
+        if (record.method == TrafficCapture::Method::Other) record.otherMethod = method.substr(0, 32);
+        record.path = path;
+        record.range = getHeader(request, "Range");
+        record.acceptEncoding = getHeader(request, "Accept-Encoding");
+        record.ifNoneMatch = getHeader(request, "If-None-Match");
+        std::string contentLength = getHeader(request, "Content-Length");
+        if (!contentLength.empty()) record.requestBytes = std::strtoull(contentLength.c_str(), nullptr, 10);
+    }
+
+    // Runs on every continue/break out of the request loop
+    ~CaptureScope() {
+        if (!capture) return;
+        record.status = (uint16_t)connection.m_status;
+        record.responseBytes = connection.m_wireBytes - wireBytesBefore;
+        record.durationUs = capture->nowUs() - record.startUs;
+        capture->write(record);
+    }
+};
+
 void HttpConnection::handle() {
-    // OPTIMIZATION: Set Receive Timeout (20s) to handle Keep-Alive without zombies
-#ifdef _WIN32
-    DWORD timeout = 20000;
-    setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-#else
-    struct timeval tv;
-    tv.tv_sec = 20;
-    tv.tv_usec = 0;
-    setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-#endif
+    // OPTIMIZATION: Timeouts come from the server's timer wheel instead of
+    // SO_RCVTIMEO, so header trickling, stalled uploads and stuck sends are
+    // cut off too, not just silent keep-alive sockets
+    if (m_ctx.tls) {
+        TraceScope span("tls_handshake");
+        armTimer("handshake", kHeaderTimeoutMs);
+        m_tls = std::make_unique<TlsSession>(*m_ctx.tls, m_socket);
+        if (!m_tls->handshake()) return; // Plain HTTP on the TLS port, or aborted handshake
+    }
 
     char buffer[8192]; // Larger request buffer
 
     while (true) {
-        int bytesRead = recv(m_socket, buffer, sizeof(buffer) - 1, 0);
-        if (bytesRead <= 0) break; // Connection closed, timeout, or error
+        // Server shutting down: finish here instead of waiting for another request
+        if (!m_ctx.connections->markIdle(m_id)) break;
+
+        std::string request;
+        {
+            TraceScope span("wait_request"); // Includes keep-alive idle time
+            armTimer("idle", kIdleTimeoutMs);
+            int bytesRead = recvSome(buffer, sizeof(buffer));
+            if (bytesRead <= 0) break; // Connection closed, timeout, or error
+            request.append(buffer, bytesRead);
+        }
+        m_ctx.connections->markBusy(m_id);
+        TraceScope requestSpan("request");
+
+        // The whole header block must arrive within one fixed deadline, so
+        // trickling a byte at a time does not keep the thread
+        if (request.find("\r\n\r\n") == std::string::npos) {
+            TraceScope span("read_headers");
+            armTimer("header", kHeaderTimeoutMs);
+            bool complete = false;
+            while (!complete && request.size() < kMaxHeaderBytes) {
+                int bytesRead = recvSome(buffer, sizeof(buffer));
+                if (bytesRead <= 0) break;
+                size_t scanFrom = request.size() > 3 ? request.size() - 3 : 0; // Terminator may straddle reads
+                request.append(buffer, bytesRead);
+                complete = request.find("\r\n\r\n", scanFrom) != std::string::npos;
+            }
+            if (!complete) {
+                if (request.size() >= kMaxHeaderBytes) sendError(431, "Request Header Fields Too Large");
+                break;
+            }
+        }
+        armTimer("send", kSendStallMs); // Re-armed by every chunk of progress
 
-        buffer[bytesRead] = '\0';
-        std::string request(buffer);
         std::istringstream iss(request);
         std::string method, path, protocol;
         iss >> method >> path >> protocol;
 
         if (method.empty()) break;
+        CaptureScope capture(*this, method, path, request);
+
+        LiveStats::setPath(m_slot, urlDecode(path));
+        m_acceptEncoding = getHeader(request, "Accept-Encoding");
+        m_encoding = negotiateEncoding(m_acceptEncoding);
 
         // --- AUTHENTICATION ---
         if (!m_password.empty()) {
@@ -132,10 +292,10 @@ void HttpConnection::handle() {
                         // Trim whitespace
                         providedPass.erase(providedPass.find_last_not_of(" \n\r\t") + 1);
                         
-                        if (providedPass == m_password) {
+                        if (providedPass == m_password && m_ctx.sessions) {
                             std::ostringstream response;
                             response << "HTTP/1.1 302 Found\r\n"
-                                     << "Set-Cookie: auth=1; Path=/\r\n"
+                                     << "Set-Cookie: session=" << m_ctx.sessions->create() << "; Path=/; HttpOnly; SameSite=Lax" << (m_tls ? "; Secure" : "") << "\r\n"
                                      << "Location: /\r\n"
                                      << "Content-Length: 0\r\n\r\n";
                             sendResponse(response.str());
@@ -153,7 +313,17 @@ void HttpConnection::handle() {
             }
         }
 
+        // --- DEBUG: Chrome/Perfetto trace dump, read-only and from this machine only ---
+        // (the sample rate belongs to the GUI)
+        if (method == "GET" && path.rfind("/debug/trace", 0) == 0) {
+            if (!isLoopbackPeer()) { sendError(403, "Forbidden"); continue; }
+            sendText("application/json", Tracer::dumpChromeJson());
+            m_log("Serving Trace Dump");
+            continue;
+        }
+
         if (method == "POST" && path.find("/upload") == 0) {
+            TraceScope uploadSpan("upload");
             std::string filename = "uploaded_file";
             size_t qPos = path.find("name=");
             if (qPos != std::string::npos) {
@@ -165,42 +335,97 @@ void HttpConnection::handle() {
                 if (lastSlash != std::string::npos) filename = filename.substr(lastSlash + 1);
             }
 
-            // Find Content-Length
-            size_t clPos = request.find("Content-Length: ");
-            int contentLength = 0;
-            if (clPos != std::string::npos) {
-                // Simple parse, assumes header is well formed
-                size_t endCl = request.find("\r\n", clPos);
-                if (endCl != std::string::npos) {
-                    contentLength = std::stoi(request.substr(clPos + 16, endCl - (clPos + 16)));
-                }
-            }
+            int64_t contentLength = std::strtoll(getHeader(request, "Content-Length").c_str(), nullptr, 10);
 
             // Find start of body (after \r\n\r\n)
             size_t bodyPos = request.find("\r\n\r\n");
             if (bodyPos == std::string::npos) { sendError(400, "Bad Request"); continue; }
             bodyPos += 4;
+            int64_t unread = contentLength - (int64_t)(request.size() - bodyPos);
 
-            std::string body = request.substr(bodyPos);
-            int bytesReceived = body.length();
+            // Optional client digest; verified against the CRC computed while receiving
+            std::string expectedHeader = getHeader(request, "X-Checksum-CRC32C");
+            uint32_t expectedCrc = 0;
+            if (!expectedHeader.empty() && !Crc32c::parse(expectedHeader, expectedCrc)) {
+                sendError(400, "Bad Checksum Header");
+                discardBody(unread);
+                break;
+            }
 
-            // Open file
-            std::ofstream outfile(fs::path(m_rootDir) / filename, std::ios::binary);
+            AdmissionControl::Ticket ticket;
+            if (!admit(ticket, AdmissionControl::Class::Upload, false)) {
+                discardBody(unread);
+                break;
+            }
+
+            // Hidden until complete: not listed, and a bad upload never replaces a good file.
+            // Created exclusively, so concurrent uploads of one name never share a temp file.
+            fs::path target = fs::path(m_rootDir) / filename;
+            fs::path partial;
+            for (int attempt = 0; partial.empty() && attempt < 100; ++attempt) {
+                fs::path candidate = fs::path(m_rootDir) / ("." + filename + "." + std::to_string(m_id) + "-" + std::to_string(attempt) + ".part");
+                if (std::FILE* created = std::fopen(candidate.string().c_str(), "wbx")) {
+                    std::fclose(created);
+                    partial = candidate;
+                }
+            }
+            if (partial.empty()) {
+                sendError(500, "Internal Server Error");
+                discardBody(unread);
+                break;
+            }
+
+            std::string body = request.substr(bodyPos);
+            int64_t bytesReceived = body.length();
+            std::ofstream outfile(partial, std::ios::binary);
             outfile.write(body.c_str(), body.length());
+            Crc32c crc;
+            crc.update(body.data(), body.size());
 
-            // Read remaining bytes
-            int bytesLeft = contentLength - bytesReceived;
-            char upBuf[8192];
+            // Read remaining bytes, hashing each chunk while it is still in cache
+            int64_t bytesLeft = contentLength - bytesReceived;
+            char upBuf[64 * 1024];
+            int windowBytes = 0;
+            armTimer("body", kBodyWindowMs);
             while (bytesLeft > 0) {
-                int r = recv(m_socket, upBuf, std::min((int)sizeof(upBuf), bytesLeft), 0);
+                int r = recvSome(upBuf, (int)std::min<int64_t>(sizeof(upBuf), bytesLeft));
                 if (r <= 0) break;
+                crc.update(upBuf, r);
                 outfile.write(upBuf, r);
                 bytesLeft -= r;
+                // Minimum body rate: each window must bring kMinBodyBytes
+                windowBytes += r;
+                if (windowBytes >= kMinBodyBytes) {
+                    armTimer("body", kBodyWindowMs);
+                    windowBytes = 0;
+                }
             }
+            armTimer("send", kSendStallMs);
             outfile.close();
 
-            sendResponse("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
-            m_log("Uploaded: " + filename);
+            std::error_code fsError;
+            if (bytesLeft > 0 || !outfile) {
+                fs::remove(partial, fsError);
+                m_log("Upload failed: " + filename);
+                break;
+            }
+            if (!expectedHeader.empty() && crc.value() != expectedCrc) {
+                fs::remove(partial, fsError);
+                sendError(400, "Checksum Mismatch");
+                m_log("Upload rejected, CRC32C " + Crc32c::toHex(crc.value()) + " != " + Crc32c::toHex(expectedCrc) + ": " + filename);
+                continue;
+            }
+            // Stamped before the rename: the checksum describes exactly the bytes that go live
+            Crc32c::store(partial, crc.value());
+            fs::rename(partial, target, fsError);
+            if (fsError) {
+                fs::remove(partial, fsError);
+                sendError(500, "Internal Server Error");
+                continue;
+            }
+
+            sendResponse("HTTP/1.1 200 OK\r\nX-Checksum-CRC32C: " + Crc32c::toHex(crc.value()) + "\r\nContent-Length: 0\r\n\r\n");
+            m_log("Uploaded: " + filename + " (CRC32C " + Crc32c::toHex(crc.value()) + ")");
             continue;
         }
 
@@ -209,16 +434,92 @@ void HttpConnection::handle() {
             break; // Close on error
         }
 
+        // Remove query string (before decoding, so a name with an encoded '?' stays whole)
+        std::string query;
+        size_t queryPos = path.find('?');
+        if (queryPos != std::string::npos) {
+            query = path.substr(queryPos + 1);
+            path = path.substr(0, queryPos);
+        }
+
         path = urlDecode(path);
         if (path.find("..") != std::string::npos) {
             sendError(403, "Forbidden");
             break;
         }
 
-        // Remove query string
-        size_t queryPos = path.find('?');
-        if (queryPos != std::string::npos) {
-            path = path.substr(0, queryPos);
+        // --- FEATURE: Live listing updates (/events?dir=/folder), Server-Sent Events ---
+        if (path == "/events") {
+            size_t dirPos = query.find("dir=");
+            std::string dir = dirPos != std::string::npos ? urlDecode(query.substr(dirPos + 4, query.find('&', dirPos) - dirPos - 4)) : "/";
+            if (dir.empty() || dir[0] != '/' || dir.find("..") != std::string::npos) dir = "/";
+            while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+            // Held for as long as the tab is open; when full, the page falls back
+            // to reloading after its own uploads and asks again later
+            // (EventSource does not retry a 503 by itself)
+            AdmissionControl::Ticket ticket;
+            if (!admit(ticket, AdmissionControl::Class::Events, false)) break;
+            streamEvents(dir);
+            break;
+        }
+
+        // --- FEATURE: Image thumbnails for the listing (/thumb/...?s=N) ---
+        if (path.rfind("/thumb/", 0) == 0 && m_ctx.thumbnails) {
+            AdmissionControl::Ticket ticket; // Resizing is CPU-bound, like rendering a listing
+            if (!admit(ticket, AdmissionControl::Class::Listing, false)) break;
+            TraceScope thumbSpan("thumbnail");
+            fs::path source = fs::path(m_rootDir) / path.substr(7);
+            size_t sizePos = query.find("s=");
+            int size = sizePos != std::string::npos ? std::atoi(query.c_str() + sizePos + 2) : 256;
+
+            std::string validator;
+            fs::path thumb;
+            if (ThumbnailCache::isImage(source)) thumb = m_ctx.thumbnails->thumbnail(source, size, validator);
+            if (thumb.empty()) {
+                sendError(404, "Not Found");
+                continue;
+            }
+            if (getHeader(request, "If-None-Match") == validator) {
+                sendResponse("HTTP/1.1 304 Not Modified\r\nETag: " + validator + "\r\nContent-Length: 0\r\n\r\n");
+                continue;
+            }
+
+            std::error_code ec;
+            uintmax_t thumbSize = fs::file_size(thumb, ec);
+            if (ec) { sendError(404, "Not Found"); continue; }
+            std::ostringstream response;
+            response << "HTTP/1.1 200 OK\r\n"
+                     << "Content-Type: " << (thumb.extension() == ".png" ? "image/png" : "image/jpeg") << "\r\n"
+                     << "Content-Length: " << thumbSize << "\r\n"
+                     << "ETag: " << validator << "\r\n"
+                     << "Cache-Control: max-age=86400\r\n"
+                     << "Connection: keep-alive\r\n\r\n";
+            sendResponse(response.str());
+            if (!sendFileRange(thumb, 0, (int64_t)thumbSize)) break;
+            continue;
+        }
+
+        // --- FEATURE: Subtitles as WebVTT for <track> (/vtt/...srt) ---
+        if (path.rfind("/vtt/", 0) == 0 && m_ctx.subtitles) {
+            AdmissionControl::Ticket ticket;
+            if (!admit(ticket, AdmissionControl::Class::Listing, false)) break;
+            fs::path source = fs::path(m_rootDir) / path.substr(5);
+            std::string ext = source.extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            std::string validator;
+            std::shared_ptr<const std::string> vtt;
+            if (ext == ".srt" || ext == ".vtt") vtt = m_ctx.subtitles->webVtt(source, validator);
+            if (!vtt) {
+                sendError(404, "Not Found");
+                continue;
+            }
+            std::string ifNoneMatch = getHeader(request, "If-None-Match");
+            if (ifNoneMatch == validator || ifNoneMatch == "W/" + validator) {
+                sendResponse("HTTP/1.1 304 Not Modified\r\nETag: " + validator + "\r\nContent-Length: 0\r\n\r\n");
+                continue;
+            }
+            sendText("text/vtt; charset=utf-8", *vtt, validator, validator);
+            continue;
         }
 
         // --- FEATURE: HTML5 Video Player Wrapper (/view/...) ---
@@ -232,13 +533,17 @@ void HttpConnection::handle() {
             fs::path realPath = fs::path(m_rootDir) / (realPathStr.substr(1));
             
             if (fs::exists(realPath) && !fs::is_directory(realPath)) {
+                AdmissionControl::Ticket ticket;
+                if (!admit(ticket, AdmissionControl::Class::Listing, false)) break;
+                TraceScope playerSpan("player");
                 std::string filename = realPath.filename().string();
-                std::string srtPath = realPathStr.substr(0, realPathStr.find_last_of('.')) + ".srt";
-                fs::path fullSrtPath = fs::path(m_rootDir) / (srtPath.substr(1));
-                bool hasSrt = fs::exists(fullSrtPath);
+                // movie.srt, movie.en.srt, movie.fr.vtt ...: served as WebVTT from /vtt/
+                std::vector<SubtitleTrack> subtitles = findSubtitles(realPath);
+                std::string dirUrl = realPathStr.substr(0, realPathStr.find_last_of('/') + 1);
 
+                // Names and paths come from the filesystem: escape for HTML, encode for URLs
                 std::ostringstream html;
-                html << "<html><head><title>" << filename << "</title>"
+                html << "<html><head><title>" << htmlEscape(filename) << "</title>"
                      << "<meta name='viewport' content='width=device-width, initial-scale=1'>"
                      << "<style>body{margin:0;background:#000;display:flex;justify-content:center;align-items:center;height:100vh;}"
                      << "video{max-width:100%;max-height:100%;box-shadow:0 0 20px #000;}"
@@ -247,7 +552,7 @@ void HttpConnection::handle() {
                      << "<script>"
                      << "window.onload = function() {"
                      << "  var vid = document.querySelector('video');"
-                     << "  var key = 'vid_pos_" << filename << "';"
+                     << "  var key = 'vid_pos_' + decodeURIComponent('" << urlEncodePath(filename) << "');"
                      << "  var saved = localStorage.getItem(key);"
                      << "  if(saved) vid.currentTime = parseFloat(saved);"
                      << "  setInterval(function(){ localStorage.setItem(key, vid.currentTime); }, 1000);"
@@ -256,29 +561,51 @@ void HttpConnection::handle() {
                      << "</head><body>"
                      << "<a href='/' class='back'>&larr; Back</a>"
                      << "<video controls autoplay playsinline>"
-                     << "<source src=\"" << realPathStr << "\" type=\"" << getMimeType(realPathStr) << "\">";
-                if (hasSrt) html << "<track label=\"Subtitle\" kind=\"subtitles\" srclang=\"en\" src=\"" << srtPath << "\" default>";
+                     << "<source src=\"" << urlEncodePath(realPathStr) << "\" type=\"" << getMimeType(realPathStr) << "\">";
+                for (size_t i = 0; i < subtitles.size(); ++i) {
+                    const SubtitleTrack& track = subtitles[i];
+                    html << "<track kind=\"subtitles\" label=\"" << htmlEscape(track.label) << "\"";
+                    if (!track.language.empty()) html << " srclang=\"" << htmlEscape(track.language) << "\"";
+                    html << " src=\"" << urlEncodePath("/vtt" + dirUrl + track.file) << "\"" << (i == 0 ? " default" : "") << ">";
+                }
                 html << "Your browser does not support the video tag.</video></body></html>";
 
-                std::string body = html.str();
-                std::ostringstream response;
-                response << "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " << body.length() 
-                         << "\r\nConnection: keep-alive\r\n\r\n" << body;
-                sendResponse(response.str());
+                sendText("text/html", html.str());
                 m_log("Serving Player for: " + filename);
                 continue; // Keep alive
             }
         }
 
+        // --- FEATURE: Download a whole folder as ZIP (/zip/...) ---
+        if (path.rfind("/zip/", 0) == 0 || path == "/zip") {
+            AdmissionControl::Ticket ticket;
+            if (!admit(ticket, AdmissionControl::Class::Stream, isResumedRange(request))) break;
+            serveFolderZip(path.substr(4), request);
+            break;
+        }
+
         fs::path fullPath = fs::path(m_rootDir) / (path == "/" ? "" : path.substr(1));
+
+        // One stat for exists/is_directory, one more for the size of files
+        std::error_code statError;
+        fs::file_status status;
+        uintmax_t fileSize = 0;
+        {
+            TraceScope span("stat");
+            status = fs::status(fullPath, statError);
+            if (fs::is_regular_file(status)) fileSize = fs::file_size(fullPath, statError);
+        }
         
-        if (!fs::exists(fullPath)) {
+        if (!fs::exists(status)) {
             sendError(404, "Not Found");
             m_log("404 Not Found: " + path);
             continue;
         }
 
-        if (fs::is_directory(fullPath)) {
+        if (fs::is_directory(status)) {
+            AdmissionControl::Ticket ticket;
+            if (!admit(ticket, AdmissionControl::Class::Listing, false)) break;
+            TraceScope listingSpan("listing");
             std::ostringstream html;
             html << "<!DOCTYPE html><html lang='en'><head>"
                  << "<meta charset='UTF-8'><meta name='viewport' content='width=device-width, initial-scale=1.0, maximum-scale=1.0, user-scalable=no'>"
@@ -302,15 +629,26 @@ void HttpConnection::handle() {
                  << ".file-item:active { background: rgba(0,0,0,0.05); }"
                  << ".icon { font-size: 24px; margin-right: 16px; width: 30px; text-align: center; flex-shrink: 0; }"
                  << ".name { font-size: 16px; font-weight: 500; word-break: break-word; }"
+                 << ".thumb { width: 48px; height: 48px; object-fit: cover; border-radius: 6px; margin-right: 16px; flex-shrink: 0; background: var(--border); }"
                  << "@media (max-width: 600px) { .container { padding: 15px; } h1 { font-size: 1.25rem; } .upload-area { flex-direction: column; align-items: stretch; } .btn { width: 100%; } }"
                  << "</style>"
                  << "<script>"
                  << "function toggleTheme() { const body = document.body; const current = body.getAttribute('data-theme'); const next = current === 'dark' ? 'light' : 'dark'; body.setAttribute('data-theme', next); localStorage.setItem('theme', next); }"
                  << "function initTheme() { const saved = localStorage.getItem('theme'); if(saved) document.body.setAttribute('data-theme', saved); }"
                  << "function filterList() { const filter = document.getElementById('search').value.toUpperCase(); const items = document.getElementsByClassName('file-item'); for (let item of items) { const txt = item.innerText; item.style.display = txt.toUpperCase().includes(filter) ? '' : 'none'; } }"
-                 << "function upload() { const file = document.getElementById('upfile').files[0]; if(!file) return; const btn = document.getElementById('upbtn'); btn.innerText = 'Uploading...'; btn.disabled = true; const xhr = new XMLHttpRequest(); xhr.open('POST', '/upload?name=' + encodeURIComponent(file.name), true); xhr.onload = function() { if(xhr.status == 200) { location.reload(); } else { alert('Error'); btn.innerText = 'Upload'; btn.disabled = false; } }; xhr.send(file); }"
+                 << "function upload() { const file = document.getElementById('upfile').files[0]; if(!file) return; const btn = document.getElementById('upbtn'); btn.innerText = 'Uploading...'; btn.disabled = true; const xhr = new XMLHttpRequest(); xhr.open('POST', '/upload?name=' + encodeURIComponent(file.name), true); xhr.onload = function() { if(xhr.status == 200) { if(!liveUpdates) location.reload(); btn.innerText = 'Upload'; btn.disabled = false; document.getElementById('upfile').value = ''; } else { alert('Error'); btn.innerText = 'Upload'; btn.disabled = false; } }; xhr.send(file); }"
+                 << "function findItem(name) { for (let item of document.getElementsByClassName('file-item')) { if (item.dataset.name === name) return item; } return null; }"
+                 << "let liveUpdates = false;"
+                 << "function watchDir() { if (!window.EventSource) return; const es = new EventSource('/events?dir=' + encodeURIComponent(decodeURIComponent(location.pathname)));"
+                 << " es.onopen = function() { liveUpdates = true; };"
+                 << " es.onerror = function() { liveUpdates = false; if (es.readyState === EventSource.CLOSED) setTimeout(watchDir, 30000); };"
+                 << " const list = document.querySelector('.file-list'); const add = function(html) { const t = document.createElement('template'); t.innerHTML = html; const el = t.content.firstChild; list.appendChild(el); filterList(); return el; };"
+                 << " es.addEventListener('add', function(e) { const d = JSON.parse(e.data); if (!findItem(d.name)) add(d.html); });"
+                 << " es.addEventListener('remove', function(e) { const el = findItem(JSON.parse(e.data).name); if (el) el.remove(); });"
+                 << " es.addEventListener('rename', function(e) { const d = JSON.parse(e.data); const el = findItem(d.from); if (el) el.remove(); if (!findItem(d.name)) add(d.html); });"
+                 << " es.addEventListener('reload', function() { location.reload(); }); }"
                  << "</script>"
-                 << "</head><body onload='initTheme()'>"
+                 << "</head><body onload='initTheme(); watchDir()'>"
                  << "<div class='container'>"
                  << "<header><h1>LAN Streamer</h1><button class='btn' onclick='toggleTheme()'>&#9790;</button></header>"
                  << "<div class='upload-area'>"
@@ -319,50 +657,64 @@ void HttpConnection::handle() {
                  << "</div>"
                  << "<input type='text' id='search' class='search-box' onkeyup='filterList()' placeholder='Search files...'>"
                  << "<div class='file-list'>";
+
+            html << "<a href=\"" << urlEncodePath("/zip" + (path == "/" ? std::string() : path)) << "\" class='file-item' download><span class='icon'>&#128230;</span><span class='name'>Download folder as ZIP</span></a>";
             
             // Add "Up Directory" link if not root
             if (path != "/") {
                 std::string parentPath = path.substr(0, path.find_last_of('/'));
                 if (parentPath.empty()) parentPath = "/";
-                html << "<a href=\"" << parentPath << "\" class='file-item'><span class='icon'>&#11013;</span><span class='name'>.. (Parent Directory)</span></a>";
+                html << "<a href=\"" << urlEncodePath(parentPath) << "\" class='file-item'><span class='icon'>&#11013;</span><span class='name'>.. (Parent Directory)</span></a>";
             }
 
             for (const auto& entry : fs::directory_iterator(fullPath)) {
                 std::string filename = entry.path().filename().string();
                 if (filename[0] == '.') continue;
-                std::string linkPath = (path == "/" ? "" : path) + "/" + filename;
-                std::string ext = filename.substr(filename.find_last_of('.') + 1);
-                std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-                
-                std::string icon = "&#128196;";
-                bool isVideo = false;
-                if (ext == "mp4" || ext == "mkv" || ext == "webm" || ext == "avi" || ext == "mov") { icon = "&#127916;"; isVideo = true; }
-                else if (ext == "mp3" || ext == "wav" || ext == "flac") icon = "&#127925;";
-                else if (ext == "jpg" || ext == "png" || ext == "gif") icon = "&#127912;";
-                else if (fs::is_directory(entry.path())) icon = "&#128193;";
-
-                if (isVideo) html << "<a href=\"/view" << linkPath << "\" class='file-item'><span class='icon'>" << icon << "</span><span class='name'>" << filename << "</span></a>";
-                else html << "<a href=\"" << linkPath << "\" class='file-item'><span class='icon'>" << icon << "</span><span class='name'>" << filename << "</span></a>";
+                // d_type from readdir, no extra stat
+                html << renderEntry(path, filename, entry.is_directory(), m_ctx.thumbnails != nullptr);
             }
             html << "</div></div></body></html>";
             
-            std::string body = html.str();
-            std::ostringstream response;
-            response << "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " << body.length() 
-                     << "\r\nConnection: keep-alive\r\n\r\n" << body;
-            sendResponse(response.str());
+            sendText("text/html", html.str());
             m_log("Serving Directory Listing");
             continue;
         }
 
-        uintmax_t fileSize = fs::file_size(fullPath);
+        // Held until the response is sent; the connection closes after a file anyway
+        AdmissionControl::Ticket ticket;
+        if (!admit(ticket, AdmissionControl::Class::Stream, isResumedRange(request))) break;
+
         std::string mimeType = getMimeType(fullPath.string());
 
         // Parse Range Header
         size_t rangePos = request.find("Range: bytes=");
+
+        // Whole-file requests for text may go out compressed; ranges always
+        // address the identity bytes, and growing files are followed instead
+        if (rangePos == std::string::npos && !m_acceptEncoding.empty() && !isGrowing(fullPath)) {
+            bool keepAlive = false;
+            if (serveCompressedFile(fullPath, fileSize, mimeType, keepAlive)) {
+                m_log("Serving: " + path + " (" + encodingName(m_encoding) + ")");
+                if (keepAlive) continue;
+                break;
+            }
+        }
+
+        // Checksum recorded at upload: a strong validator without reading the file
+        uint32_t storedCrc = 0;
+        std::string etag;
+        if (Crc32c::load(fullPath, storedCrc)) {
+            etag = "\"c" + Crc32c::toHex(storedCrc) + "-" + std::to_string(fileSize) + "\"";
+            if (getHeader(request, "If-None-Match") == etag) {
+                sendResponse("HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\nContent-Length: 0\r\n\r\n");
+                continue;
+            }
+        }
+
         int64_t start = 0;
         int64_t end = fileSize - 1;
         bool isPartial = false;
+        bool openEnded = true; // No last byte given: "bytes=N-" or no Range at all
 
         if (rangePos != std::string::npos) {
             isPartial = true;
@@ -371,17 +723,48 @@ void HttpConnection::handle() {
             size_t dashPos = rangeVal.find('-');
             try {
                 start = std::stoll(rangeVal.substr(0, dashPos));
-                if (dashPos + 1 < rangeVal.length()) end = std::stoll(rangeVal.substr(dashPos + 1));
-            } catch (...) { isPartial = false; start = 0; end = fileSize - 1; }
+                if (dashPos + 1 < rangeVal.length()) {
+                    end = std::stoll(rangeVal.substr(dashPos + 1));
+                    openEnded = false;
+                }
+            } catch (...) { isPartial = false; start = 0; end = fileSize - 1; openEnded = true; }
         }
 
-        if (end >= fileSize) end = fileSize - 1;
+        // --- FEATURE: Live follow of recordings in progress ---
+        // The whole file from the start goes out chunked and keeps growing as
+        // the recorder writes. Open-ended ranges further in get what exists now,
+        // with an unknown total length, so the player comes back for more.
+        bool growing = openEnded && isGrowing(fullPath);
+        if (growing && start == 0 && protocol == "HTTP/1.1") {
+            m_log("Following: " + path);
+            followFile(fullPath, mimeType);
+            break;
+        }
+
+        // The player asks for what follows the bytes it already has: wait for
+        // the recorder to write them, rather than answer with an empty range
+        int64_t currentSize = (int64_t)fileSize;
+        if (growing && isPartial && start >= currentSize) {
+            currentSize = waitForGrowth(fullPath, start);
+            end = currentSize - 1;
+        }
+
+        if (end >= currentSize) end = currentSize - 1;
+        if (isPartial && start > end) {
+            std::ostringstream response;
+            response << "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" << currentSize
+                     << "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            sendResponse(response.str());
+            break;
+        }
         int64_t contentLength = end - start + 1;
 
         std::ostringstream response;
         if (isPartial) {
             response << "HTTP/1.1 206 Partial Content\r\n";
-            response << "Content-Range: bytes " << start << "-" << end << "/" << fileSize << "\r\n";
+            response << "Content-Range: bytes " << start << "-" << end << "/";
+            if (growing) response << "*\r\n";
+            else response << currentSize << "\r\n";
         } else {
             response << "HTTP/1.1 200 OK\r\n";
         }
@@ -389,50 +772,28 @@ void HttpConnection::handle() {
         response << "Content-Type: " << mimeType << "\r\n";
         response << "Content-Length: " << contentLength << "\r\n";
         response << "Accept-Ranges: bytes\r\n";
+        if (!etag.empty()) {
+            response << "ETag: " << etag << "\r\n";
+            if (!isPartial) response << "X-Checksum-CRC32C: " << Crc32c::toHex(storedCrc) << "\r\n";
+        }
         response << "Connection: close\r\n";
         response << "\r\n";
 
-        sendResponse(response.str());
+        {
+            TraceScope span("send_headers");
+            sendResponse(response.str());
+        }
         m_log("Serving: " + path + (isPartial ? " (Partial)" : ""));
 
-        // --- STABLE SEND LOOP (Fixes Freezing) ---
-        FILE* fp = fopen(fullPath.string().c_str(), "rb");
-        if (fp) {
-            #ifdef _WIN32
-            _fseeki64(fp, start, SEEK_SET);
-            #else
-            fseeko(fp, start, SEEK_SET);
-            #endif
-            
-            int64_t remaining = contentLength;
-            const size_t bufSize = 65536; // 64KB Buffer (Stable for WiFi)
-            std::vector<char> buffer(bufSize);
-
-            while (remaining > 0) {
-                size_t toRead = std::min((int64_t)bufSize, remaining);
-                size_t bytesRead = fread(buffer.data(), 1, toRead, fp);
-                
-                if (bytesRead > 0) {
-                    // Ensure ALL bytes are sent
-                    char* p = buffer.data();
-                    size_t bytesLeftToSend = bytesRead;
-                    
-                    while (bytesLeftToSend > 0) {
-                        int bytesSent = send(m_socket, p, (int)bytesLeftToSend, 0);
-                        if (bytesSent <= 0) {
-                            fclose(fp);
-                            return; // Client disconnected
-                        }
-                        p += bytesSent;
-                        bytesLeftToSend -= bytesSent;
-                    }
-                    
-                    remaining -= bytesRead;
-                } else {
-                    break; // EOF or error
-                }
-            }
-            fclose(fp);
+        sendFileRange(fullPath, start, contentLength);
+
+        const TcpTuning& tcp = m_tuner.tuning();
+        if (tcp.rttUs > 0) {
+            std::ostringstream tuning;
+            tuning << "TCP " << path << ": rtt " << tcp.rttUs / 1000.0 << "ms, cwnd " << tcp.cwnd
+                   << ", sndbuf " << tcp.sendBuffer / 1024 << "K, chunk " << tcp.chunkSize / 1024 << "K, pacing "
+                   << (tcp.pacingRate ? std::to_string(tcp.pacingRate * 8 / 1000000) + "Mbit/s" : std::string("off"));
+            m_log(tuning.str());
         }
         break; // Close connection after serving file (More stable than Keep-Alive for now)
     }
@@ -449,8 +810,586 @@ void HttpConnection::sendError(int code, const std::string& message) {
     sendResponse(response.str());
 }
 
-void HttpConnection::sendResponse(const std::string& header) {
-    send(m_socket, header.c_str(), header.length(), 0);
+bool HttpConnection::admit(AdmissionControl::Ticket& ticket, AdmissionControl::Class cls, bool resumedStream) {
+    if (!m_ctx.admission) return true;
+    {
+        TraceScope span("admission");
+        ticket = m_ctx.admission->admit(cls, resumedStream);
+    }
+    if (ticket) return true;
+
+    const std::string message = "Server busy, please retry shortly";
+    std::ostringstream response;
+    response << "HTTP/1.1 503 Service Unavailable\r\n"
+             << "Retry-After: " << AdmissionControl::kRetryAfterSeconds << "\r\n"
+             << "Content-Type: text/plain\r\n"
+             << "Content-Length: " << message.length() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << message;
+    sendResponse(response.str());
+    return false;
+}
+
+bool HttpConnection::isResumedRange(const std::string& request) {
+    // "bytes=N-" with N > 0: a player continuing or seeking within a file
+    std::string range = getHeader(request, "Range");
+    return range.rfind("bytes=", 0) == 0 && std::strtoll(range.c_str() + 6, nullptr, 10) > 0;
+}
+
+bool HttpConnection::sendResponse(const std::string& header) {
+    if (header.rfind("HTTP/1.1 ", 0) == 0) m_status = std::atoi(header.c_str() + 9);
+    return sendAll(header.c_str(), header.length());
+}
+
+std::string HttpConnection::getHeader(const std::string& request, const std::string& name) {
+    // Case-insensitive search for "\r\nName:" within the header block
+    size_t headerEnd = request.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) headerEnd = request.size();
+    size_t pos = request.find("\r\n");
+    while (pos != std::string::npos && pos < headerEnd) {
+        size_t lineStart = pos + 2;
+        size_t lineEnd = request.find("\r\n", lineStart);
+        if (lineEnd == std::string::npos) lineEnd = request.size();
+        if (lineEnd - lineStart > name.size() && request[lineStart + name.size()] == ':') {
+            bool match = true;
+            for (size_t i = 0; i < name.size() && match; ++i) {
+                match = ::tolower((unsigned char)request[lineStart + i]) == ::tolower((unsigned char)name[i]);
+            }
+            if (match) {
+                size_t valueStart = request.find_first_not_of(" \t", lineStart + name.size() + 1);
+                if (valueStart == std::string::npos || valueStart > lineEnd) return "";
+                return request.substr(valueStart, lineEnd - valueStart);
+            }
+        }
+        pos = lineEnd < headerEnd ? lineEnd : std::string::npos;
+    }
+    return "";
+}
+
+void HttpConnection::sendText(const std::string& contentType, const std::string& body, const std::string& validator,
+                              const std::string& etag) {
+    std::shared_ptr<const std::string> encoded;
+    if (m_encoding != ContentEncoding::Identity && m_ctx.compression && body.size() >= 256) {
+        std::string key = validator.empty()
+            ? "h:" + std::to_string(std::hash<std::string>{}(body)) + ":" + std::to_string(body.size())
+            : validator;
+        TraceScope span("compress");
+        encoded = m_ctx.compression->get(key, m_encoding, body);
+    }
+    const std::string& payload = encoded ? *encoded : body;
+
+    TraceScope span("send_text");
+    std::ostringstream response;
+    response << "HTTP/1.1 200 OK\r\nContent-Type: " << contentType << "\r\n";
+    if (encoded) response << "Content-Encoding: " << encodingName(m_encoding) << "\r\n";
+    if (!etag.empty()) response << "ETag: " << (encoded ? "W/" : "") << etag << "\r\n";
+    response << "Vary: Accept-Encoding\r\nContent-Length: " << payload.size()
+             << "\r\nConnection: keep-alive\r\n\r\n";
+    sendResponse(response.str());
+    sendAll(payload.data(), payload.size());
+}
+
+bool HttpConnection::serveCompressedFile(const fs::path& path, uintmax_t fileSize, const std::string& mimeType, bool& keepAlive) {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) return false;
+
+    // Only text types have compressed variants. A movie.mp4.gz or an unrelated
+    // report.pdf.br next to a file must never stand in for it.
+    if (!isCompressibleMime(mimeType)) return false;
+
+    // Precompressed sibling (video.json.gz, app.js.br) newer than the source:
+    // no CPU spent, and it still goes out on the zero-copy path
+    for (ContentEncoding encoding : acceptedEncodings(m_acceptEncoding)) {
+        fs::path sibling = path;
+        sibling += encodingSuffix(encoding);
+        if (!fs::is_regular_file(sibling, ec) || fs::last_write_time(sibling, ec) < mtime) continue;
+        uintmax_t size = fs::file_size(sibling, ec);
+        if (ec) continue;
+
+        std::ostringstream response;
+        response << "HTTP/1.1 200 OK\r\nContent-Type: " << mimeType << "\r\n"
+                 << "Content-Encoding: " << encodingName(encoding) << "\r\n"
+                 << "Vary: Accept-Encoding\r\nContent-Length: " << size << "\r\n"
+                 << "Connection: close\r\n\r\n";
+        sendResponse(response.str());
+        m_encoding = encoding;
+        sendFileRange(sibling, 0, (int64_t)size);
+        keepAlive = false;
+        return true;
+    }
+
+    // On-the-fly for small text files; the compressed copy is cached by validator
+    const uintmax_t maxOnTheFly = 4 * 1024 * 1024;
+    if (m_encoding == ContentEncoding::Identity || !m_ctx.compression ||
+        fileSize < 256 || fileSize > maxOnTheFly) {
+        return false;
+    }
+
+    std::string validator = path.string() + "|" + std::to_string(mtime.time_since_epoch().count())
+                          + "|" + std::to_string(fileSize);
+    bool cached = false;
+    std::shared_ptr<const std::string> encoded = m_ctx.compression->lookup(validator, m_encoding, cached);
+    if (!cached) {
+        std::ifstream in(path, std::ios::binary);
+        std::string body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (body.size() != fileSize) return false;
+        encoded = m_ctx.compression->get(validator, m_encoding, body);
+    }
+    if (!encoded) return false;
+
+    std::ostringstream response;
+    response << "HTTP/1.1 200 OK\r\nContent-Type: " << mimeType << "\r\n"
+             << "Content-Encoding: " << encodingName(m_encoding) << "\r\n"
+             << "Vary: Accept-Encoding\r\nContent-Length: " << encoded->size() << "\r\n"
+             << "Connection: keep-alive\r\n\r\n";
+    sendResponse(response.str());
+    sendAll(encoded->data(), encoded->size());
+    keepAlive = true;
+    return true;
+}
+
+std::string HttpConnection::htmlEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '&') out += "&amp;";
+        else if (c == '<') out += "&lt;";
+        else if (c == '"') out += "&quot;";
+        else if (c == '\'') out += "&#39;";
+        else out += c;
+    }
+    return out;
+}
+
+std::string HttpConnection::urlEncodePath(const std::string& path) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : path) {
+        if (std::isalnum(c) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += (char)c;
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+    return out;
+}
+
+std::string HttpConnection::renderEntry(const std::string& dirPath, const std::string& filename, bool isDirectory, bool thumbnails) {
+    std::string linkPath = urlEncodePath((dirPath == "/" ? "" : dirPath) + "/" + filename);
+    std::string name = htmlEscape(filename);
+    std::string ext = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    std::string icon = "&#128196;";
+    bool isVideo = false;
+    bool isImage = thumbnails && !isDirectory && ThumbnailCache::isImage(filename);
+    if (ext == "mp4" || ext == "mkv" || ext == "webm" || ext == "avi" || ext == "mov") { icon = "&#127916;"; isVideo = true; }
+    else if (ext == "mp3" || ext == "wav" || ext == "flac") icon = "&#127925;";
+    else if (ext == "jpg" || ext == "png" || ext == "gif") icon = "&#127912;";
+    else if (isDirectory) icon = "&#128193;";
+
+    std::ostringstream html;
+    html << "<a href=\"" << (isVideo ? "/view" : "") << linkPath << "\" class='file-item' data-name=\"" << name << "\">";
+    // Thumbnails only load once scrolled into view, at 128px (enough for 48 CSS px on HiDPI)
+    if (isImage) html << "<img class='thumb' loading='lazy' decoding='async' alt='' src=\"/thumb" << linkPath << "?s=128\">";
+    else html << "<span class='icon'>" << icon << "</span>";
+    html << "<span class='name'>" << name << "</span></a>";
+    return html.str();
+}
+
+void HttpConnection::streamEvents(const std::string& dir) {
+    std::shared_ptr<DirectoryWatcher::Subscription> subscription;
+    if (m_ctx.watcher) subscription = m_ctx.watcher->subscribe(dir);
+    if (!subscription) {
+        sendError(404, "Not Found"); // No watcher here: the page keeps working without live updates
+        return;
+    }
+
+    m_log("Watching: " + dir);
+    const std::string header = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                               "Connection: close\r\n\r\nretry: 3000\n\n";
+    bool ok = sendResponse(header);
+    // Comment lines keep proxies and the send-stall timer happy and reveal dead clients
+    const auto heartbeat = std::chrono::seconds(15);
+    auto lastWrite = std::chrono::steady_clock::now();
+    // A closed subscription (folder deleted) has queued a reload as its last message
+    while (ok && !m_ctx.connections->isDraining() && !DirectoryWatcher::isClosed(*subscription)) {
+        auto messages = DirectoryWatcher::wait(*subscription, std::chrono::milliseconds(1000));
+        for (const auto& message : messages) {
+            if (!(ok = sendAll(message->data(), message->size()))) break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (!messages.empty()) lastWrite = now;
+        else if (now - lastWrite >= heartbeat) {
+            ok = sendAll(": ping\n\n", 8);
+            lastWrite = now;
+        }
+    }
+    m_ctx.watcher->unsubscribe(subscription);
+}
+
+bool HttpConnection::isGrowing(const fs::path& path) {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec || fs::file_time_type::clock::now() - mtime >= kGrowingWindow) return false;
+    uint32_t crc = 0;
+    return !Crc32c::load(path, crc); // Valid only while size and mtime match the upload
+}
+
+void HttpConnection::followFile(const fs::path& path, const std::string& mimeType) {
+    // Subscribe before the first size check, so no append can slip between the two
+    std::shared_ptr<DirectoryWatcher::Subscription> subscription;
+    if (m_ctx.watcher) subscription = m_ctx.watcher->followFile(path.string());
+
+    std::ostringstream header;
+    header << "HTTP/1.1 200 OK\r\nContent-Type: " << mimeType << "\r\n"
+           << "Transfer-Encoding: chunked\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n";
+    bool ok = sendResponse(header.str());
+
+    int64_t offset = 0;
+    auto lastGrowth = std::chrono::steady_clock::now();
+    while (ok && !m_ctx.connections->isDraining()) {
+        // Checked before the size, so a close seen here covers every write before it
+        bool writerDone = subscription && DirectoryWatcher::isWriteClosed(*subscription);
+        std::error_code ec;
+        int64_t size = (int64_t)fs::file_size(path, ec);
+        if (ec || size < offset) break; // Deleted, or truncated and rewritten
+
+        if (size > offset) {
+            // Everything appended since the last chunk, zero-copy like any file body
+            char chunkHeader[32];
+            int headerLength = std::snprintf(chunkHeader, sizeof(chunkHeader), "%llx\r\n", (unsigned long long)(size - offset));
+            ok = sendAll(chunkHeader, (size_t)headerLength) && sendFileRange(path, offset, size - offset) && sendAll("\r\n", 2);
+            offset = size;
+            lastGrowth = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        if (writerDone || std::chrono::steady_clock::now() - lastGrowth >= kFollowIdle) break;
+        if (subscription && !DirectoryWatcher::isClosed(*subscription)) DirectoryWatcher::wait(*subscription, std::chrono::milliseconds(1000));
+        else std::this_thread::sleep_for(kFollowPoll);
+    }
+    if (ok) sendAll("0\r\n\r\n", 5);
+    if (subscription) m_ctx.watcher->unsubscribe(subscription);
+}
+
+int64_t HttpConnection::waitForGrowth(const fs::path& path, int64_t offset) {
+    std::shared_ptr<DirectoryWatcher::Subscription> subscription;
+    if (m_ctx.watcher) subscription = m_ctx.watcher->followFile(path.string());
+
+    auto deadline = std::chrono::steady_clock::now() + kRangeWait;
+    int64_t size = 0;
+    for (;;) {
+        bool writerDone = subscription && DirectoryWatcher::isWriteClosed(*subscription);
+        std::error_code ec;
+        size = (int64_t)fs::file_size(path, ec);
+        if (ec) { size = 0; break; }
+        auto now = std::chrono::steady_clock::now();
+        if (size > offset || writerDone || now >= deadline || m_ctx.connections->isDraining()) break;
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+        if (subscription && !DirectoryWatcher::isClosed(*subscription)) DirectoryWatcher::wait(*subscription, timeout);
+        else std::this_thread::sleep_for(std::min<std::chrono::milliseconds>(timeout, kFollowPoll));
+    }
+    if (subscription) m_ctx.watcher->unsubscribe(subscription);
+    return size;
+}
+
+void HttpConnection::serveFolderZip(const std::string& path, const std::string& request) {
+    fs::path dir = fs::path(m_rootDir) / (path.size() > 1 ? path.substr(1) : "");
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec)) {
+        sendError(404, "Not Found");
+        return;
+    }
+
+    std::string error;
+    std::shared_ptr<const ZipArchive> archive;
+    {
+        TraceScope span("zip_layout");
+        archive = ZipArchive::open(dir, *m_ctx.zipHasher, error);
+    }
+    if (!archive) {
+        sendError(500, "Internal Server Error");
+        m_log("ZIP failed for " + path + ": " + error);
+        return;
+    }
+
+    std::string name = path.size() > 1 ? fs::path(path).filename().string() : "";
+    if (name.empty()) name = fs::path(m_rootDir).filename().string();
+    if (name.empty()) name = "files";
+
+    if (getHeader(request, "If-None-Match") == archive->etag()) {
+        sendResponse("HTTP/1.1 304 Not Modified\r\nETag: " + archive->etag() + "\r\nConnection: close\r\n\r\n");
+        return;
+    }
+
+    // Same single-range handling as files; a stale If-Range gets the whole archive
+    const uint64_t totalSize = archive->totalSize();
+    uint64_t start = 0;
+    uint64_t end = totalSize - 1;
+    std::string range = getHeader(request, "Range");
+    std::string ifRange = getHeader(request, "If-Range");
+    bool isPartial = range.rfind("bytes=", 0) == 0 && (ifRange.empty() || ifRange == archive->etag());
+    if (isPartial) {
+        size_t dashPos = range.find('-');
+        try {
+            start = std::stoull(range.substr(6, dashPos - 6));
+            if (dashPos + 1 < range.length()) end = std::stoull(range.substr(dashPos + 1));
+        } catch (...) { isPartial = false; start = 0; end = totalSize - 1; }
+        if (end >= totalSize) end = totalSize - 1;
+        if (isPartial && start > end) {
+            std::ostringstream response;
+            response << "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" << totalSize
+                     << "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            sendResponse(response.str());
+            return;
+        }
+    }
+    uint64_t contentLength = end - start + 1;
+
+    // A download from the start never gets far ahead of the CRC hasher. A range
+    // further in has the checksums it needs hashed first, while its member data
+    // is already going out.
+    if (start > 0) archive->prioritize(start, contentLength);
+
+    std::ostringstream response;
+    if (isPartial) {
+        response << "HTTP/1.1 206 Partial Content\r\n";
+        response << "Content-Range: bytes " << start << "-" << end << "/" << totalSize << "\r\n";
+    } else {
+        response << "HTTP/1.1 200 OK\r\n";
+    }
+    response << "Content-Type: application/zip\r\n";
+    // Quoted ASCII fallback, plus the exact UTF-8 name for clients that read filename*
+    std::string fallback;
+    for (unsigned char c : name + ".zip") {
+        if (c == '"' || c == '\\') fallback += '\\';
+        fallback += (c < 0x20 || c >= 0x7F) ? '_' : (char)c;
+    }
+    response << "Content-Disposition: attachment; filename=\"" << fallback << "\"; filename*=UTF-8''"
+             << urlEncodePath(name + ".zip") << "\r\n";
+    response << "Content-Length: " << contentLength << "\r\n";
+    response << "ETag: " << archive->etag() << "\r\n";
+    response << "Accept-Ranges: bytes\r\n";
+    response << "Connection: close\r\n";
+    response << "\r\n";
+    sendResponse(response.str());
+    m_log("Serving ZIP: " + path + " (" + std::to_string(archive->entryCount()) + " files" + (isPartial ? ", Partial)" : ")"));
+
+    // Headers come from memory, member data through the zero-copy file path
+    uint64_t position = start;
+    ZipArchive::Sink sink;
+    sink.writeBytes = [this, &position](const char* data, size_t length) {
+        if (!sendAll(data, length)) return false;
+        position += length;
+        onBodySent(length, position);
+        return true;
+    };
+    sink.writeFile = [this, &position](const fs::path& file, uint64_t offset, uint64_t length) {
+        if (!sendFileRange(file, (int64_t)offset, (int64_t)length)) return false;
+        position += length;
+        return true;
+    };
+    // Waiting for the hasher is progress too; a draining server gives up
+    sink.keepAlive = [this] {
+        extendTimer("send", kSendStallMs);
+        return !m_ctx.connections->isDraining();
+    };
+    TraceScope span("send_zip");
+    archive->stream(start, contentLength, sink);
+}
+
+void HttpConnection::armTimer(const char* tag, uint32_t milliseconds) {
+    if (!m_ctx.timers) return;
+    m_ctx.timers->arm(m_timer, milliseconds, tag);
+    m_timerTag = tag;
+    m_timerArmedNs = steadyNowNs();
+}
+
+void HttpConnection::extendTimer(const char* tag, uint32_t milliseconds) {
+    // Same deadline re-armed within the last second: skip the wheel lock
+    if (m_timerTag && std::strcmp(tag, m_timerTag) == 0 && steadyNowNs() - m_timerArmedNs < 1000000000) return;
+    armTimer(tag, milliseconds);
+}
+
+void HttpConnection::onBodySent(uint64_t bytes, uint64_t offset) {
+    extendTimer("send", kSendStallMs);
+    m_stats.bytesSent += bytes;
+    m_tuner.onSent((size_t)bytes);
+    m_stats.tcp = m_tuner.tuning();
+
+    LiveStats::addBytes(m_slot, bytes, offset);
+    if (m_slot) {
+        m_slot->rttUs.store(m_stats.tcp.rttUs, std::memory_order_relaxed);
+        m_slot->sendBuffer.store((uint32_t)m_stats.tcp.sendBuffer, std::memory_order_relaxed);
+        m_slot->pacingRate.store(m_stats.tcp.pacingRate, std::memory_order_relaxed);
+    }
+}
+
+int HttpConnection::recvSome(char* buffer, int length) {
+    if (m_tls) return m_tls->read(buffer, length);
+    return recv(m_socket, buffer, length, 0);
+}
+
+void HttpConnection::discardBody(int64_t bytesLeft) {
+    char buffer[64 * 1024];
+    armTimer("linger", kLingerMs);
+    int64_t budget = kDiscardBodyBytes;
+    while (bytesLeft > 0 && budget > 0) {
+        int r = recvSome(buffer, (int)std::min<int64_t>(sizeof(buffer), std::min(bytesLeft, budget)));
+        if (r <= 0) return;
+        bytesLeft -= r;
+        budget -= r;
+    }
+    if (bytesLeft <= 0) return;
+
+    // Too much to read off: send FIN after the response, and keep reading until
+    // the client closes too (or the timer fires). A close with unread data
+    // would send a reset that can discard the response before it is read.
+#ifdef _WIN32
+    shutdown(m_socket, SD_SEND);
+#else
+    shutdown(m_socket, SHUT_WR);
+#endif
+    while (recvSome(buffer, sizeof(buffer)) > 0) {}
+}
+
+bool HttpConnection::sendAll(const char* data, size_t length) {
+    while (length > 0) {
+        int chunk = (int)std::min(length, (size_t)(1 << 30));
+        int bytesSent = m_tls ? m_tls->write(data, chunk) : send(m_socket, data, chunk, 0);
+        if (bytesSent <= 0) return false; // Client disconnected
+        m_wireBytes += (uint64_t)bytesSent;
+        extendTimer("send", kSendStallMs);
+        data += bytesSent;
+        length -= bytesSent;
+    }
+    return true;
+}
+
+bool HttpConnection::sendFileRange(const fs::path& path, int64_t start, int64_t length) {
+    TraceScope bodySpan("send_body");
+    const uint64_t blockedSendNs = 1000000; // Per-chunk spans only when a send stalled >= 1ms
+#ifdef __linux__
+    // Zero-copy: page cache -> socket via sendfile, or via SSL_sendfile when
+    // the kernel owns the TLS record layer (kTLS). User-space TLS falls through
+    // to the copy loop below.
+    if (!m_tls || m_tls->kernelSend()) {
+        int fd;
+        {
+            TraceScope span("open_file");
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return false;
+            posix_fadvise(fd, start, length, POSIX_FADV_SEQUENTIAL);
+        }
+
+        // HDD: the device queue reads ahead in large elevator-ordered windows
+        // and sendfile then finds the data in the page cache
+        std::unique_ptr<DiskReader> reader;
+        if (DiskScheduler::Device* disk = m_ctx.disks ? m_ctx.disks->deviceFor(fd) : nullptr) {
+            reader = std::make_unique<DiskReader>(*m_ctx.disks, disk, fd, (uint64_t)start, (uint64_t)length, false);
+        }
+        int64_t readyEnd = reader ? start : start + length;
+
+        off_t offset = start;
+        int64_t remaining = length;
+        while (remaining > 0) {
+            if (reader && offset >= readyEnd) {
+                TraceScope span("disk_wait", blockedSendNs);
+                uint64_t windowOffset;
+                size_t windowLength;
+                const char* unused;
+                if (reader->next(windowOffset, windowLength, unused)) {
+                    readyEnd = (int64_t)(windowOffset + windowLength);
+                } else {
+                    reader.reset(); // Read error: let sendfile report it
+                    readyEnd = start + length;
+                }
+            }
+            // Bounded calls keep stalls on WiFi short; size follows the path's BDP
+            size_t toSend = (size_t)std::min({(int64_t)m_tuner.chunkSize(), remaining, readyEnd - (int64_t)offset});
+            int64_t sent;
+            TraceScope chunkSpan("sendfile", blockedSendNs);
+            if (m_tls) {
+                sent = m_tls->sendFile(fd, offset, toSend);
+                if (sent > 0) offset += sent;
+            } else {
+                sent = sendfile(m_socket, fd, &offset, toSend);
+            }
+            if (sent <= 0) break; // Client disconnected or file truncated
+            m_wireBytes += (uint64_t)sent;
+            remaining -= sent;
+            onBodySent((uint64_t)sent, (uint64_t)offset);
+        }
+        reader.reset(); // Waits for its read in flight before the fd goes
+        close(fd);
+        return remaining == 0;
+    }
+#endif
+
+    // --- STABLE SEND LOOP (Fixes Freezing) ---
+    FILE* fp;
+    {
+        TraceScope span("open_file");
+        fp = fopen(path.string().c_str(), "rb");
+        if (!fp) return false;
+        #ifdef _WIN32
+        _fseeki64(fp, start, SEEK_SET);
+        #else
+        fseeko(fp, start, SEEK_SET);
+        #endif
+    }
+
+#ifdef __linux__
+    // User-space TLS from an HDD: double-buffered windows from the device queue
+    if (DiskScheduler::Device* disk = m_ctx.disks ? m_ctx.disks->deviceFor(fileno(fp)) : nullptr) {
+        DiskReader reader(*m_ctx.disks, disk, fileno(fp), (uint64_t)start, (uint64_t)length, true);
+        uint64_t windowOffset;
+        size_t windowLength;
+        const char* data;
+        int64_t sentTotal = 0;
+        while (true) {
+            {
+                TraceScope span("disk_wait", blockedSendNs);
+                if (!reader.next(windowOffset, windowLength, data)) break;
+            }
+            bool ok = true;
+            for (size_t pos = 0; pos < windowLength && ok; ) {
+                size_t toSend = std::min(m_tuner.chunkSize(), windowLength - pos);
+                TraceScope chunkSpan("send", blockedSendNs);
+                ok = sendAll(data + pos, toSend);
+                pos += toSend;
+                if (ok) onBodySent(toSend, windowOffset + pos);
+            }
+            if (!ok) break; // Client disconnected
+            sentTotal += (int64_t)windowLength;
+        }
+        fclose(fp);
+        return sentTotal == length;
+    }
+#endif
+
+    int64_t remaining = length;
+    std::vector<char> buffer;
+
+    while (remaining > 0) {
+        size_t toRead = std::min((int64_t)m_tuner.chunkSize(), remaining);
+        if (buffer.size() < toRead) buffer.resize(toRead);
+        size_t bytesRead;
+        {
+            TraceScope span("fread", blockedSendNs);
+            bytesRead = fread(buffer.data(), 1, toRead, fp);
+        }
+        if (bytesRead == 0) break; // EOF or error
+        TraceScope chunkSpan("send", blockedSendNs);
+        if (!sendAll(buffer.data(), bytesRead)) break; // Client disconnected
+        remaining -= bytesRead;
+        onBodySent(bytesRead, (uint64_t)(start + length - remaining));
+    }
+    fclose(fp);
+    return remaining == 0;
 }
 
 }
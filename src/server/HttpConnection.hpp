@@ -2,7 +2,17 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
 #include <functional>
+#include <filesystem>
+#include <cstdint>
+#include "TlsContext.hpp"
+#include "ServerContext.hpp"
+#include "TcpTuner.hpp"
+#include "Compression.hpp"
+#include "LiveStats.hpp"
+#include "TimerWheel.hpp"
+#include "AdmissionControl.hpp"
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -17,25 +27,98 @@
 
 namespace Server {
 
+struct ConnectionStats {
+    uint64_t bytesSent = 0;   // Response bodies only
+    TcpTuning tcp;            // Settings chosen by TcpTuner for this client
+};
+
 class HttpConnection {
 public:
-    HttpConnection(SocketType socket, const std::string& rootDir, const std::string& password, std::function<void(const std::string&)> logCallback);
+    HttpConnection(SocketType socket, const ServerContext& context, uint64_t id);
     ~HttpConnection();
 
     void handle();
+    const ConnectionStats& stats() const { return m_stats; }
+
+    // One row of the directory listing; also used for live-update fragments
+    static std::string renderEntry(const std::string& dirPath, const std::string& filename, bool isDirectory, bool thumbnails);
+    // For attribute values and text: escapes & < " (and ' for single-quoted attributes)
+    static std::string htmlEscape(const std::string& text);
+    // For links: percent-encodes every byte except unreserved characters and '/'
+    static std::string urlEncodePath(const std::string& path);
 
 private:
     bool checkAuth(const std::string& request);
+    bool isLoopbackPeer() const;
     void sendLogin();
 
     SocketType m_socket;
     std::string m_rootDir;
     std::string m_password;
     std::function<void(const std::string&)> m_log;
+    const ServerContext& m_ctx;
+    uint64_t m_id;
+    TcpTuner m_tuner;
+    ConnectionStats m_stats;
+    LiveStats::Slot* m_slot;      // Published to the GUI dashboard; may be null
+    std::string m_acceptEncoding; // Of the current request
+    ContentEncoding m_encoding;   // Negotiated for generated/cached bodies
+    std::unique_ptr<TlsSession> m_tls;
+    TimerWheel::Timer m_timer;           // Current deadline; expiry shuts the socket down
+    std::atomic<const char*> m_timedOut; // Tag of the deadline that fired, or null
+    const char* m_timerTag;
+    int64_t m_timerArmedNs;
+    int m_status;                // Of the last response header sent, for the traffic capture
+    uint64_t m_wireBytes;        // Headers and bodies sent so far (before TLS)
+
+    // Records one request into m_ctx.capture when it goes out of scope
+    struct CaptureScope;
+
+    // Deadline for the current phase (idle, header, body, send)
+    void armTimer(const char* tag, uint32_t milliseconds);
+    // Pushes the deadline out after progress; cheap enough to call per chunk
+    void extendTimer(const char* tag, uint32_t milliseconds);
+
+    // Takes a slot of the class, or answers 503 + Retry-After and returns false
+    bool admit(AdmissionControl::Ticket& ticket, AdmissionControl::Class cls, bool resumedStream);
+    static bool isResumedRange(const std::string& request);
 
     void sendError(int code, const std::string& message);
-    void sendResponse(const std::string& header);
+    bool sendResponse(const std::string& header);
+
+    // Transport wrappers: plaintext socket or TLS session
+    int recvSome(char* buffer, int length);
+    // Before closing on an early error response: reads and discards up to a
+    // bounded part of an unread request body, then stops sending and lingers,
+    // so the client reads the response instead of getting a reset
+    void discardBody(int64_t bytesLeft);
+    bool sendAll(const char* data, size_t length);
+    bool sendFileRange(const std::filesystem::path& path, int64_t start, int64_t length);
+    void onBodySent(uint64_t bytes, uint64_t offset);
     std::string urlDecode(const std::string& str);
+    static std::string getHeader(const std::string& request, const std::string& name);
+
+    // 200 response with a body from memory, compressed when the client allows.
+    // validator keys the compressed-variant cache; empty hashes the body.
+    // etag, when given, is sent too (as a weak tag for a compressed variant).
+    void sendText(const std::string& contentType, const std::string& body, const std::string& validator = "",
+                  const std::string& etag = "");
+    // Serves a precompressed sibling or a cached compressed copy of a text file.
+    // Returns false when the plain file should be sent instead.
+    bool serveCompressedFile(const std::filesystem::path& path, uintmax_t fileSize, const std::string& mimeType, bool& keepAlive);
+    // Streams a folder as a store-mode ZIP, with Range support
+    void serveFolderZip(const std::string& path, const std::string& request);
+    // Server-Sent Events for one folder until the client leaves or the server drains
+    void streamEvents(const std::string& dir);
+    // Modified within the last few seconds and without an upload checksum
+    // (uploads are complete when renamed in), so probably still being recorded
+    static bool isGrowing(const std::filesystem::path& path);
+    // Chunked response that sends appended data as it is written, until the
+    // writer closes the file, it stops growing, or the client leaves
+    void followFile(const std::filesystem::path& path, const std::string& mimeType);
+    // For a range starting at or past the end of a growing file: waits a
+    // bounded time for the writer to append past offset. Returns the size then.
+    int64_t waitForGrowth(const std::filesystem::path& path, int64_t offset);
 };
 
 }
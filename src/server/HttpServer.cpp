@@ -1,13 +1,38 @@
 #include "HttpServer.hpp"
 #include "HttpConnection.hpp"
+#include "Trace.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+    #include <csignal>
+#endif
+#ifdef __linux__
+    #include <pthread.h>
+    #include <sched.h>
+#endif
 
 namespace Server {
 
-HttpServer::HttpServer() : m_running(false), m_serverSocket(-1), m_activeConnections(0) {
+static void closeSocket(SocketType socket) {
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+HttpServer::HttpServer()
+    : m_running(false), m_port(0), m_activeConnections(0),
+      m_listenerCount(0), m_backlog(1024), m_cpuAffinity(false), m_drainTimeoutMs(5000), m_zipHasher(&m_disks) {
 #ifdef _WIN32
     WSADATA wsaData;
     WSAStartup(MAKEWORD(2, 2), &wsaData);
+#else
+    // A client vanishing mid-send must fail the send, not kill the process
+    signal(SIGPIPE, SIG_IGN);
 #endif
 }
 
@@ -25,50 +50,204 @@ bool HttpServer::start(int port, const std::string& rootDir, const std::string&
     m_rootDir = rootDir;
     m_password = password;
     m_activeConnections = 0;
-    if (m_clientCountCallback) m_clientCountCallback(0);
 
-    m_serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_serverSocket == -1) {
+    m_tls.reset();
+    if (!m_tlsCertPath.empty()) {
+        auto tls = std::make_unique<TlsContext>();
+        std::string error;
+        if (!tls->init(m_tlsCertPath, m_tlsKeyPath, m_tlsAltNames, error)) {
+            if (m_logCallback) m_logCallback("TLS setup failed: " + error);
+            return false;
+        }
+        m_tls = std::move(tls);
+        if (m_logCallback) {
+            m_logCallback(TlsContext::kernelTlsAvailable()
+                ? "HTTPS enabled (kernel TLS offload available)"
+                : "HTTPS enabled (kernel TLS module not loaded, using user-space encryption)");
+        }
+    }
+
+    int listenerCount = m_listenerCount > 0 ? m_listenerCount : (int)std::thread::hardware_concurrency();
+#ifndef SO_REUSEPORT
+    listenerCount = 1;
+#endif
+    if (listenerCount < 1) listenerCount = 1;
+    bool sharePort = listenerCount > 1;
+
+    // SO_REUSEPORT would also let us bind next to another server already on
+    // the port, so make sure the port is free with a plain bind first
+    if (sharePort && !probePort(port)) return false;
+
+    for (int i = 0; i < listenerCount; ++i) {
+        auto listener = std::make_unique<Listener>();
+        listener->socket = openListener(port, i, sharePort);
+        if (listener->socket == (ListenSocket)-1) {
+            closeListeners();
+            return false;
+        }
+        m_listeners.push_back(std::move(listener));
+    }
+
+    m_context.rootDir = m_rootDir;
+    m_context.password = m_password;
+    m_context.log = m_logCallback;
+    m_context.tls = m_tls.get();
+    m_context.connections = &m_connections;
+    m_context.compression = &m_compression;
+    m_context.stats = &m_liveStats;
+    m_context.timers = &m_timers;
+    m_context.thumbnails = &m_thumbnails;
+    m_context.disks = &m_disks;
+    m_context.zipHasher = &m_zipHasher;
+    m_context.subtitles = &m_subtitles;
+    m_context.admission = &m_admission;
+    m_sessions.clear(); // Logins of an earlier run may have used another password
+    m_context.sessions = &m_sessions;
+    m_context.capture = nullptr;
+    if (!m_capturePath.empty()) {
+        if (m_capture.open(m_capturePath)) {
+            m_context.capture = &m_capture;
+            if (m_logCallback) m_logCallback("Capturing traffic to " + m_capturePath);
+        } else if (m_logCallback) {
+            m_logCallback("Cannot write traffic capture " + m_capturePath);
+        }
+    }
+    bool thumbnails = m_context.thumbnails != nullptr;
+    m_context.watcher = m_watcher.start(m_rootDir, [thumbnails](const std::string& dir, const std::string& name, bool isDirectory) {
+        return HttpConnection::renderEntry(dir, name, isDirectory, thumbnails);
+    }) ? &m_watcher : nullptr;
+
+    m_timers.start();
+
+    m_running = true;
+    for (size_t i = 0; i < m_listeners.size(); ++i) {
+        Listener* listener = m_listeners[i].get();
+        listener->thread = std::thread(&HttpServer::acceptLoop, this, listener, (int)i);
+    }
+    
+    if (m_logCallback) {
+        m_logCallback("Server started on port " + std::to_string(port) + " ("
+                      + std::to_string(m_listeners.size()) + " listener"
+                      + (m_listeners.size() > 1 ? "s" : "") + ", backlog "
+                      + std::to_string(m_backlog) + ")");
+    }
+    return true;
+}
+
+bool HttpServer::probePort(int port) {
+    ListenSocket sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == (ListenSocket)-1) {
         if (m_logCallback) m_logCallback("Failed to create socket");
         return false;
     }
+#ifndef _WIN32
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#endif
+    sockaddr_in serverAddr;
+    std::memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(port);
+
+    bool available = bind(sock, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == 0;
+    if (!available && m_logCallback) m_logCallback("Failed to bind to port " + std::to_string(port));
+    closeSocket(sock);
+    return available;
+}
+
+HttpServer::ListenSocket HttpServer::openListener(int port, int index, bool sharePort) {
+#ifdef __linux__
+    ListenSocket sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+    ListenSocket sock = socket(AF_INET, SOCK_STREAM, 0);
+#endif
+    if (sock == (ListenSocket)-1) {
+        if (m_logCallback) m_logCallback("Failed to create socket");
+        return (ListenSocket)-1;
+    }
+
+#ifndef _WIN32
+    // SO_REUSEADDR on Windows would allow port hijacking, so only set it here
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#endif
+#ifdef SO_REUSEPORT
+    // Every listener binds the same port; the kernel spreads incoming
+    // connections across them, so accept() no longer funnels through one queue
+    if (sharePort) setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#else
+    (void)sharePort;
+#endif
+#if defined(__linux__) && defined(SO_INCOMING_CPU)
+    if (m_cpuAffinity) {
+        // Steer connections whose packets arrive on this core to this listener
+        int cpu = index % (int)std::max(1u, std::thread::hardware_concurrency());
+        setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    }
+#else
+    (void)index;
+#endif
 
     sockaddr_in serverAddr;
+    std::memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
     serverAddr.sin_port = htons(port);
 
-    if (bind(m_serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+    if (bind(sock, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
         if (m_logCallback) m_logCallback("Failed to bind to port " + std::to_string(port));
-        return false;
+        closeSocket(sock);
+        return (ListenSocket)-1;
     }
 
-    if (listen(m_serverSocket, 10) < 0) {
+    if (listen(sock, m_backlog) < 0) {
         if (m_logCallback) m_logCallback("Failed to listen");
-        return false;
+        closeSocket(sock);
+        return (ListenSocket)-1;
     }
+    return sock;
+}
 
-    m_running = true;
-    m_acceptThread = std::thread(&HttpServer::acceptLoop, this);
-    
-    if (m_logCallback) m_logCallback("Server started on port " + std::to_string(port));
-    return true;
+void HttpServer::closeListeners() {
+    for (auto& listener : m_listeners) {
+        // shutdown() wakes a blocked accept() on Linux; close() alone does not
+#ifdef _WIN32
+        closesocket(listener->socket);
+#else
+        shutdown(listener->socket, SHUT_RDWR);
+#endif
+    }
+    for (auto& listener : m_listeners) {
+        if (listener->thread.joinable()) listener->thread.join();
+#ifndef _WIN32
+        close(listener->socket);
+#endif
+    }
+    m_listeners.clear();
 }
 
 void HttpServer::stop() {
     if (!m_running) return;
     m_running = false;
 
-#ifdef _WIN32
-    closesocket(m_serverSocket);
-#else
-    close(m_serverSocket);
-#endif
+    closeListeners();
 
-    if (m_acceptThread.joinable()) {
-        m_acceptThread.join();
+    // Drain: idle keep-alive sockets close now, in-flight responses may finish
+    m_connections.beginDrain();
+    int inFlight = m_connections.count();
+    if (inFlight > 0) {
+        if (m_logCallback) m_logCallback("Waiting for " + std::to_string(inFlight) + " connection(s) to finish");
+        if (!m_connections.waitForDrain(std::chrono::milliseconds(m_drainTimeoutMs))) {
+            if (m_logCallback) m_logCallback("Drain timeout, closing " + std::to_string(m_connections.count()) + " connection(s)");
+            m_connections.abortAndWait();
+        }
     }
-    
+    m_connections.reset();
+    m_timers.stop(); // Only after every connection (and its timer) is gone
+    m_watcher.stop();
+    m_capture.close();
+
     if (m_logCallback) m_logCallback("Server stopped");
 }
 
@@ -80,11 +259,88 @@ void HttpServer::setLogCallback(std::function<void(const std::string&)> callback
     m_logCallback = callback;
 }
 
-void HttpServer::setClientCountCallback(std::function<void(int)> callback) {
-    m_clientCountCallback = callback;
+ServerSnapshot HttpServer::snapshot() const {
+    ServerSnapshot snapshot = m_liveStats.snapshot();
+    snapshot.activeConnections = m_activeConnections.load(std::memory_order_relaxed);
+    snapshot.rejectedRequests = m_admission.rejected();
+    return snapshot;
+}
+
+void HttpServer::setTlsCertificate(const std::string& certPath, const std::string& keyPath,
+                                   const std::vector<std::string>& altNames) {
+    m_tlsCertPath = certPath;
+    m_tlsKeyPath = keyPath;
+    m_tlsAltNames = altNames;
+}
+
+bool HttpServer::isTlsEnabled() const {
+    return m_tls != nullptr;
+}
+
+void HttpServer::setListenerCount(int count) {
+    m_listenerCount = std::max(0, count);
+}
+
+void HttpServer::setListenBacklog(int backlog) {
+    m_backlog = std::max(1, backlog);
+}
+
+void HttpServer::setCpuAffinity(bool enabled) {
+    m_cpuAffinity = enabled;
+}
+
+void HttpServer::setDrainTimeout(int milliseconds) {
+    m_drainTimeoutMs = std::max(0, milliseconds);
+}
+
+void HttpServer::setThumbnailCacheDir(const std::string& dir) {
+    m_thumbnails.setCacheDir(dir);
+}
+
+void HttpServer::setDiskScheduling(DiskScheduler::Mode mode) {
+    m_disks.setMode(mode);
 }
 
-void HttpServer::acceptLoop() {
+void HttpServer::setAdmissionLimits(const AdmissionControl::Limits& limits) {
+    m_admission.setLimits(limits);
+}
+
+void HttpServer::setCaptureFile(const std::string& path) {
+    m_capturePath = path;
+}
+
+void HttpServer::rejectOverloaded(ListenSocket socket) {
+    m_admission.countRejection();
+    if (!m_tls) {
+        static const std::string response = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: "
+            + std::to_string(AdmissionControl::kRetryAfterSeconds)
+            + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+#ifdef _WIN32
+        send(socket, response.data(), (int)response.size(), 0); // Empty send buffer: completes at once
+#else
+        // Read what already arrived so close() sends FIN rather than RST, which
+        // would discard the 503 before the client reads it
+        char discard[4096];
+        (void)!recv(socket, discard, sizeof(discard), MSG_DONTWAIT);
+        (void)!send(socket, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+    }
+    closeSocket(socket);
+}
+
+void HttpServer::acceptLoop(Listener* listener, int index) {
+#ifdef __linux__
+    if (m_cpuAffinity) {
+        // Connection threads inherit this mask, keeping a shard on one core
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % (int)std::max(1u, std::thread::hardware_concurrency()), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#else
+    (void)index;
+#endif
+
     while (m_running) {
         sockaddr_in clientAddr;
 #ifdef _WIN32
@@ -93,22 +349,65 @@ void HttpServer::acceptLoop() {
         socklen_t clientLen = sizeof(clientAddr);
 #endif
         
-        SocketType clientSocket = accept(m_serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
+#ifdef __linux__
+        // Accepted sockets stay blocking: each connection owns a thread
+        SocketType clientSocket = accept4(listener->socket, (struct sockaddr*)&clientAddr, &clientLen, SOCK_CLOEXEC);
+#else
+        SocketType clientSocket = accept(listener->socket, (struct sockaddr*)&clientAddr, &clientLen);
+#endif
         
-        if (!m_running) break; // Check again after unblocking accept
+        if (!m_running) { // Check again after unblocking accept
+            if (clientSocket != (SocketType)-1) closeSocket(clientSocket);
+            break;
+        }
 
-        if (clientSocket != -1) {
-            m_activeConnections++;
-            if (m_clientCountCallback) m_clientCountCallback(m_activeConnections.load());
+        if (clientSocket == (SocketType)-1) {
+#ifndef _WIN32
+            // Out of descriptors: back off instead of spinning on the full backlog
+            if (errno == EMFILE || errno == ENFILE) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+#endif
+            continue;
+        }
+
+        // Connection storm: answer from here, without spending a thread on it
+        if (m_activeConnections.load(std::memory_order_relaxed) >= m_admission.limits().connections) {
+            rejectOverloaded(clientSocket);
+            continue;
+        }
 
-            // Spawn a new thread for each client
-            std::thread([this, clientSocket]() {
-                HttpConnection conn(clientSocket, m_rootDir, m_password, m_logCallback);
-                conn.handle();
+        uint64_t acceptedAt = Tracer::nowNs();
+        bool sampled = Tracer::shouldSample();
+
+        uint64_t id = m_connections.add(clientSocket);
+        if (id == 0) { // Draining
+            closeSocket(clientSocket);
+            continue;
+        }
+
+        m_activeConnections++;
+
+        try {
+            // Spawn a new thread for each client; stop() waits for it through m_connections
+            std::thread([this, clientSocket, id, sampled, acceptedAt]() {
+                Tracer::beginConnection(sampled, id);
+                if (sampled) Tracer::record("thread_start", acceptedAt, Tracer::nowNs());
+                {
+                    HttpConnection conn(clientSocket, m_context, id);
+                    conn.handle();
+                }
                 
                 m_activeConnections--;
-                if (m_clientCountCallback) m_clientCountCallback(m_activeConnections.load());
+                m_connections.remove(id); // Last use of this
             }).detach();
+        } catch (const std::system_error&) {
+            m_activeConnections--;
+            m_connections.closeSocket(id);
+            m_connections.remove(id);
+        }
+
+        if (sampled) {
+            Tracer::beginConnection(true, id);
+            Tracer::record("accept", acceptedAt, Tracer::nowNs());
         }
     }
 }
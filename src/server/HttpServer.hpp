@@ -5,6 +5,21 @@
 #include <thread>
 #include <functional>
 #include <vector>
+#include <memory>
+#include "TlsContext.hpp"
+#include "ConnectionManager.hpp"
+#include "ServerContext.hpp"
+#include "Compression.hpp"
+#include "LiveStats.hpp"
+#include "TimerWheel.hpp"
+#include "ThumbnailCache.hpp"
+#include "DiskScheduler.hpp"
+#include "ZipStream.hpp"
+#include "DirectoryWatcher.hpp"
+#include "Subtitles.hpp"
+#include "AdmissionControl.hpp"
+#include "TrafficCapture.hpp"
+#include "SessionStore.hpp"
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -24,26 +39,85 @@ public:
     void stop();
     bool isRunning() const;
     void setLogCallback(std::function<void(const std::string&)> callback);
-    void setClientCountCallback(std::function<void(int)> callback);
+
+    // Lock-free copy of per-connection counters, meant to be polled (e.g. by a GUI timer)
+    ServerSnapshot snapshot() const;
+
+    // Serve HTTPS with the given PEM files (generated self-signed when missing).
+    // Empty paths switch back to plain HTTP. Takes effect on the next start().
+    void setTlsCertificate(const std::string& certPath, const std::string& keyPath,
+                           const std::vector<std::string>& altNames = {});
+    bool isTlsEnabled() const;
+
+    // Number of SO_REUSEPORT listeners, each with its own accept thread.
+    // 0 (default) means one per CPU core. Always 1 where SO_REUSEPORT is missing.
+    void setListenerCount(int count);
+    void setListenBacklog(int backlog);
+    // Pin listener N (and the connections it accepts) to core N
+    void setCpuAffinity(bool enabled);
+    // How long stop() lets in-flight responses finish before cutting them off
+    void setDrainTimeout(int milliseconds);
+    // Folder for generated image thumbnails (kept across runs)
+    void setThumbnailCacheDir(const std::string& dir);
+    // Per-device read queues; Auto (default) uses them for spinning disks only
+    void setDiskScheduling(DiskScheduler::Mode mode);
+    // Concurrent streams/listings/uploads and total connections before 503s
+    void setAdmissionLimits(const AdmissionControl::Limits& limits);
+    // Record request metadata to this file for localwaves-replay (truncated on
+    // each start). Empty (default) disables capture. Takes effect on the next start().
+    void setCaptureFile(const std::string& path);
 
 private:
-    void acceptLoop();
+#ifdef _WIN32
+    using ListenSocket = SOCKET;
+#else
+    using ListenSocket = int;
+#endif
+
+    struct Listener {
+        ListenSocket socket;
+        std::thread thread;
+    };
+
+    bool probePort(int port);
+    ListenSocket openListener(int port, int index, bool sharePort);
+    void closeListeners();
+    void acceptLoop(Listener* listener, int index);
+    // Best-effort 503 on a fresh socket, never blocking the accept thread
+    void rejectOverloaded(ListenSocket socket);
 
     std::atomic<bool> m_running;
     std::string m_rootDir;
     std::string m_password;
     int m_port;
     std::atomic<int> m_activeConnections;
-    std::function<void(int)> m_clientCountCallback;
     std::function<void(const std::string&)> m_logCallback;
-    
-#ifdef _WIN32
-    SOCKET m_serverSocket;
-#else
-    int m_serverSocket;
-#endif
 
-    std::thread m_acceptThread;
+    std::string m_tlsCertPath;
+    std::string m_tlsKeyPath;
+    std::vector<std::string> m_tlsAltNames;
+    std::unique_ptr<TlsContext> m_tls;
+
+    int m_listenerCount;
+    int m_backlog;
+    bool m_cpuAffinity;
+    int m_drainTimeoutMs;
+
+    std::vector<std::unique_ptr<Listener>> m_listeners;
+    ConnectionManager m_connections;
+    CompressionCache m_compression;
+    LiveStats m_liveStats;
+    TimerWheel m_timers;
+    ThumbnailCache m_thumbnails;
+    DiskScheduler m_disks;
+    ZipHasher m_zipHasher; // Reads through m_disks, so declared (and stopped) after it
+    DirectoryWatcher m_watcher;
+    SubtitleCache m_subtitles;
+    AdmissionControl m_admission;
+    std::string m_capturePath;
+    TrafficCapture m_capture;
+    SessionStore m_sessions;
+    ServerContext m_context;
 };
 
 }
@@ -0,0 +1,132 @@
+#include "LiveStats.hpp"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+namespace Server {
+
+static uint64_t steadyNowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LiveStats::LiveStats(size_t slots) : m_slots(new Slot[slots]), m_count(slots) {}
+
+LiveStats::Slot* LiveStats::acquire(uint64_t connectionId, const std::string& clientIp) {
+    for (size_t i = 0; i < m_count; ++i) {
+        Slot* slot = &m_slots[i];
+        uint64_t expected = 0;
+        if (slot->connectionId.load(std::memory_order_relaxed) != 0) continue;
+        if (!slot->connectionId.compare_exchange_strong(expected, connectionId, std::memory_order_acq_rel)) continue;
+
+        slot->startNs.store(steadyNowNs(), std::memory_order_relaxed);
+        slot->offset.store(0, std::memory_order_relaxed);
+        slot->bytesSent.store(0, std::memory_order_relaxed);
+        slot->rttUs.store(0, std::memory_order_relaxed);
+        slot->sendBuffer.store(0, std::memory_order_relaxed);
+        slot->pacingRate.store(0, std::memory_order_relaxed);
+        writeText(slot, slot->clientIp, sizeof(slot->clientIp), clientIp);
+        writeText(slot, slot->path, sizeof(slot->path), "");
+        return slot;
+    }
+    return nullptr;
+}
+
+void LiveStats::release(Slot* slot) {
+    if (!slot) return;
+    // Take the bytes (zeroed while still owned, so the next owner never shows
+    // them), unpublish, then retire them. A snapshot overlapping any step
+    // sees m_releasing or m_releases change and scans again.
+    m_releasing.fetch_add(1, std::memory_order_seq_cst);
+    uint64_t bytes = slot->bytesSent.exchange(0, std::memory_order_seq_cst);
+    slot->connectionId.store(0, std::memory_order_seq_cst);
+    m_retiredBytes.fetch_add(bytes, std::memory_order_seq_cst);
+    m_releases.fetch_add(1, std::memory_order_seq_cst);
+    m_releasing.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void LiveStats::setPath(Slot* slot, const std::string& path) {
+    if (!slot) return;
+    writeText(slot, slot->path, sizeof(slot->path), path);
+}
+
+void LiveStats::addBytes(Slot* slot, uint64_t bytes, uint64_t offset) {
+    if (!slot) return;
+    // Single writer per slot: load+store is enough and avoids a locked RMW
+    slot->bytesSent.store(slot->bytesSent.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+    slot->offset.store(offset, std::memory_order_relaxed);
+}
+
+void LiveStats::writeText(Slot* slot, char* field, size_t size, const std::string& value) {
+    uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    size_t n = std::min(value.size(), size - 1);
+    std::memcpy(field, value.data(), n);
+    field[n] = '\0';
+    slot->seq.store(seq + 2, std::memory_order_release);
+}
+
+ServerSnapshot LiveStats::snapshot() const {
+    ServerSnapshot result;
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        uint64_t releases = m_releases.load(std::memory_order_seq_cst);
+        bool busy = m_releasing.load(std::memory_order_seq_cst) != 0;
+        result = scan();
+        if (!busy && m_releasing.load(std::memory_order_seq_cst) == 0 &&
+            m_releases.load(std::memory_order_seq_cst) == releases) break;
+    }
+    return result; // After 8 overlapped attempts the last scan is close enough
+}
+
+ServerSnapshot LiveStats::scan() const {
+    ServerSnapshot result;
+    uint64_t now = steadyNowNs();
+    uint64_t liveBytes = 0;
+    uint64_t retiredBytes = m_retiredBytes.load(std::memory_order_seq_cst);
+
+    for (size_t i = 0; i < m_count; ++i) {
+        const Slot* slot = &m_slots[i];
+        uint64_t id = slot->connectionId.load(std::memory_order_acquire);
+        if (id == 0) continue;
+
+        ConnectionSnapshot conn;
+        char ip[sizeof(slot->clientIp)];
+        char path[sizeof(slot->path)];
+        bool consistent = false;
+        for (int attempt = 0; attempt < 4 && !consistent; ++attempt) {
+            uint32_t before = slot->seq.load(std::memory_order_acquire);
+            if (before & 1) continue; // Writer in progress
+            std::memcpy(ip, slot->clientIp, sizeof(ip));
+            std::memcpy(path, slot->path, sizeof(path));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            consistent = slot->seq.load(std::memory_order_relaxed) == before;
+        }
+        if (!consistent) continue; // Skip this poll; the next one will catch it
+        ip[sizeof(ip) - 1] = '\0';
+        path[sizeof(path) - 1] = '\0';
+
+        conn.id = id;
+        conn.clientIp = ip;
+        conn.path = path;
+        conn.offset = slot->offset.load(std::memory_order_relaxed);
+        conn.bytesSent = slot->bytesSent.load(std::memory_order_relaxed);
+        uint64_t start = slot->startNs.load(std::memory_order_relaxed);
+        conn.ageSeconds = now > start ? (now - start) / 1e9 : 0;
+        conn.rttUs = slot->rttUs.load(std::memory_order_relaxed);
+        conn.sendBuffer = slot->sendBuffer.load(std::memory_order_relaxed);
+        conn.pacingRate = slot->pacingRate.load(std::memory_order_relaxed);
+
+        // Slot recycled while we read it: drop the mixed record
+        if (slot->connectionId.load(std::memory_order_acquire) != id) continue;
+
+        liveBytes += conn.bytesSent;
+        result.connections.push_back(std::move(conn));
+    }
+
+    result.activeConnections = (int)result.connections.size();
+    result.totalBytesSent = retiredBytes + liveBytes;
+    return result;
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Server {
+
+// Point-in-time copy of one connection, as read by the GUI
+struct ConnectionSnapshot {
+    uint64_t id = 0;
+    std::string clientIp;
+    std::string path;        // Last request path
+    uint64_t offset = 0;     // Current position in the file being sent
+    uint64_t bytesSent = 0;  // File body bytes over the connection's lifetime
+    double ageSeconds = 0;
+    uint32_t rttUs = 0;
+    uint32_t sendBuffer = 0;
+    uint64_t pacingRate = 0;
+};
+
+struct ServerSnapshot {
+    std::vector<ConnectionSnapshot> connections;
+    uint64_t totalBytesSent = 0; // Including connections that already closed
+    int activeConnections = 0;
+    uint64_t rejectedRequests = 0; // 503s from admission control since start
+};
+
+// Fixed table of per-connection counters that connection threads write and
+// the GUI polls. Writers and readers never block each other: counters are
+// relaxed atomics and the two strings sit behind a per-slot seqlock, so
+// polling costs the server nothing beyond the cache lines it touches.
+class LiveStats {
+public:
+    struct Slot {
+        std::atomic<uint64_t> connectionId{0}; // 0 = free
+        std::atomic<uint32_t> seq{0};          // Odd while text is being written
+        char clientIp[48] = {};
+        char path[256] = {};
+        std::atomic<uint64_t> startNs{0};
+        std::atomic<uint64_t> offset{0};
+        std::atomic<uint64_t> bytesSent{0};
+        std::atomic<uint32_t> rttUs{0};
+        std::atomic<uint32_t> sendBuffer{0};
+        std::atomic<uint64_t> pacingRate{0};
+    };
+
+    explicit LiveStats(size_t slots = 1024);
+
+    // Returns nullptr when the table is full (the connection is just not shown)
+    Slot* acquire(uint64_t connectionId, const std::string& clientIp);
+    void release(Slot* slot);
+
+    static void setPath(Slot* slot, const std::string& path);
+    static void addBytes(Slot* slot, uint64_t bytes, uint64_t offset);
+
+    ServerSnapshot snapshot() const;
+
+private:
+    static void writeText(Slot* slot, char* field, size_t size, const std::string& value);
+    ServerSnapshot scan() const;
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_count;
+    std::atomic<uint64_t> m_retiredBytes{0};
+    // A slot's bytes move to m_retiredBytes on release; snapshot() retries
+    // when a release overlapped its scan, so they are never counted twice
+    std::atomic<uint32_t> m_releasing{0};
+    std::atomic<uint64_t> m_releases{0};
+};
+
+}
@@ -18,7 +18,7 @@ inline std::string getMimeType(const std::string& path) {
         {".html", "text/html"}, {".htm", "text/html"},
         {".css", "text/css"}, {".js", "application/javascript"},
         {".json", "application/json"}, {".xml", "application/xml"},
-        {".txt", "text/plain"}, {".srt", "text/plain"}, {".vtt", "text/vtt"},
+        {".txt", "text/plain"}, {".srt", "application/x-subrip"}, {".vtt", "text/vtt"},
 
         // Video
         {".mp4", "video/mp4"}, {".m4v", "video/mp4"},
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+namespace Server {
+
+class TlsContext;
+class ConnectionManager;
+class CompressionCache;
+class LiveStats;
+class TimerWheel;
+class ThumbnailCache;
+class DiskScheduler;
+class DirectoryWatcher;
+class SubtitleCache;
+class AdmissionControl;
+class TrafficCapture;
+class ZipHasher;
+class SessionStore;
+
+// Server-wide state shared (read-only) by every HttpConnection.
+// Owned by HttpServer and valid for as long as any connection thread runs.
+struct ServerContext {
+    std::string rootDir;
+    std::string password;
+    std::function<void(const std::string&)> log;
+    TlsContext* tls = nullptr;
+    ConnectionManager* connections = nullptr;
+    CompressionCache* compression = nullptr;
+    LiveStats* stats = nullptr;
+    TimerWheel* timers = nullptr;
+    ThumbnailCache* thumbnails = nullptr;
+    DiskScheduler* disks = nullptr;
+    ZipHasher* zipHasher = nullptr;
+    DirectoryWatcher* watcher = nullptr;
+    SubtitleCache* subtitles = nullptr;
+    AdmissionControl* admission = nullptr;
+    TrafficCapture* capture = nullptr;  // Null unless capturing
+    SessionStore* sessions = nullptr;
+};
+
+}
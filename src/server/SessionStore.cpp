@@ -0,0 +1,40 @@
+#include "SessionStore.hpp"
+
+#include <cstdint>
+#include <random>
+
+namespace Server {
+
+std::string SessionStore::create() {
+    // 128 bits from the OS entropy source, hex encoded
+    static const char* hex = "0123456789abcdef";
+    std::random_device random;
+    std::string token;
+    token.reserve(32);
+    for (int i = 0; i < 4; ++i) {
+        uint32_t word = random();
+        for (int shift = 28; shift >= 0; shift -= 4) token += hex[(word >> shift) & 0xF];
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_tokens.insert(token).second) m_order.push_back(token);
+    while (m_order.size() > kMaxSessions) {
+        m_tokens.erase(m_order.front());
+        m_order.pop_front();
+    }
+    return token;
+}
+
+bool SessionStore::isValid(const std::string& token) const {
+    if (token.empty()) return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tokens.count(token) != 0;
+}
+
+void SessionStore::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tokens.clear();
+    m_order.clear();
+}
+
+}
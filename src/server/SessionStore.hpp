@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace Server {
+
+// Login sessions of a password-protected share.
+//
+// Each successful login gets its own random token, sent back as the session
+// cookie; checkAuth accepts only tokens issued by this server run. The store
+// keeps the newest kMaxSessions tokens, so repeated logins cannot grow it
+// without bound, and start() clears it since the password may have changed.
+class SessionStore {
+public:
+    static constexpr size_t kMaxSessions = 1024;
+
+    std::string create();
+    bool isValid(const std::string& token) const;
+    void clear();
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_set<std::string> m_tokens;
+    std::deque<std::string> m_order; // Oldest first, for eviction
+};
+
+}
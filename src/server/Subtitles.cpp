@@ -0,0 +1,334 @@
+#include "Subtitles.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace Server {
+
+namespace {
+
+bool isValidUtf8(const std::string& text) {
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = (unsigned char)text[i];
+        size_t extra = c < 0x80 ? 0 : (c >> 5) == 0x6 ? 1 : (c >> 4) == 0xE ? 2 : (c >> 3) == 0x1E ? 3 : 4;
+        if (extra == 4 || (extra && i + extra >= text.size())) return false;
+        for (size_t k = 1; k <= extra; ++k) {
+            if (((unsigned char)text[i + k] >> 6) != 0x2) return false;
+        }
+        i += extra + 1;
+    }
+    return true;
+}
+
+void appendCodePoint(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | cp >> 6);
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | cp >> 12);
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | cp >> 18);
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+std::string fromWindows1252(const std::string& text) {
+    // 0x80-0x9F differ from Latin-1; 0 marks the five undefined bytes
+    static const uint16_t kHigh[32] = {
+        0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+        0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178,
+    };
+    std::string out;
+    out.reserve(text.size() + text.size() / 4);
+    for (char ch : text) {
+        unsigned char c = (unsigned char)ch;
+        uint32_t cp = c >= 0x80 && c < 0xA0 ? (kHigh[c - 0x80] ? kHigh[c - 0x80] : 0xFFFD) : c;
+        appendCodePoint(out, cp);
+    }
+    return out;
+}
+
+// "01:02:03,456", "1:02:03.4", "02:03,456" -> "01:02:03.456"; false if not a timestamp
+bool normalizeTimestamp(const std::string& text, std::string& out) {
+    long fields[4] = {0, 0, 0, 0};
+    int count = 0;
+    int fractionDigits = 0;
+    bool inFraction = false;
+    bool hasDigit = false;
+    for (char c : text) {
+        if (std::isdigit((unsigned char)c)) {
+            if (inFraction) {
+                if (fractionDigits < 3) fields[3] = fields[3] * 10 + (c - '0');
+                ++fractionDigits;
+            } else {
+                fields[count] = fields[count] * 10 + (c - '0');
+                if (fields[count] > 1000000) return false;
+            }
+            hasDigit = true;
+        } else if (c == ':' && !inFraction && hasDigit && count < 2) {
+            ++count;
+            hasDigit = false;
+        } else if ((c == ',' || c == '.') && !inFraction && hasDigit) {
+            inFraction = true;
+        } else {
+            return false;
+        }
+    }
+    if (count < 1 || !hasDigit) return false;
+    for (int i = fractionDigits; i < 3; ++i) fields[3] *= 10;
+
+    long hours = count == 2 ? fields[0] : 0;
+    long minutes = count == 2 ? fields[1] : fields[0];
+    long seconds = count == 2 ? fields[2] : fields[1];
+    if (minutes > 59 || seconds > 59) return false;
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "%02ld:%02ld:%02ld.%03ld", hours, minutes, seconds, fields[3]);
+    out = buf;
+    return true;
+}
+
+std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t");
+    if (start == std::string::npos) return "";
+    return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+}
+
+// Tags and overrides WebVTT does not understand (it keeps <i>, <b>, <u>)
+std::string cleanCueText(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '{' && i + 1 < text.size() && text[i + 1] == '\\') {
+            size_t close = text.find('}', i);
+            if (close != std::string::npos) { i = close; continue; }
+        }
+        if (text[i] == '<') {
+            size_t close = text.find('>', i);
+            std::string tag = close != std::string::npos ? text.substr(i + 1, std::min<size_t>(close - i - 1, 5)) : "";
+            std::transform(tag.begin(), tag.end(), tag.begin(), ::tolower);
+            if (tag.rfind("font", 0) == 0 || tag.rfind("/font", 0) == 0) { i = close; continue; }
+        }
+        // "-->" would end the cue text in a WebVTT parser
+        if (text.compare(i, 3, "-->") == 0) { out += "--&gt;"; i += 2; continue; }
+        out += text[i];
+    }
+    return out;
+}
+
+bool looksLikeLanguage(const std::string& tag) {
+    // "en", "pob", "pt-BR"
+    size_t dash = tag.find('-');
+    std::string primary = tag.substr(0, dash);
+    if (primary.size() < 2 || primary.size() > 3) return false;
+    if (!std::all_of(primary.begin(), primary.end(), [](char c) { return std::isalpha((unsigned char)c); })) return false;
+    if (dash == std::string::npos) return true;
+    std::string region = tag.substr(dash + 1);
+    return region.size() == 2 && std::all_of(region.begin(), region.end(), [](char c) { return std::isalpha((unsigned char)c); });
+}
+
+}
+
+SrtToVtt::SrtToVtt()
+    : m_encoding(Encoding::Unknown), m_highSurrogate(0), m_lines(0), m_passthrough(false), m_blank(true) {}
+
+void SrtToVtt::append(const char* data, size_t length) {
+    if (m_encoding == Encoding::Unknown) {
+        // Hold the first bytes until the BOM (up to 3 bytes) can be seen
+        m_pending.append(data, length);
+        if (m_pending.size() < 3) return;
+        std::string probe;
+        probe.swap(m_pending);
+        size_t skip = 0;
+        if (probe.compare(0, 3, "\xEF\xBB\xBF") == 0) { m_encoding = Encoding::Utf8; skip = 3; }
+        else if (probe.compare(0, 2, "\xFF\xFE") == 0) { m_encoding = Encoding::Utf16LE; skip = 2; }
+        else if (probe.compare(0, 2, "\xFE\xFF") == 0) { m_encoding = Encoding::Utf16BE; skip = 2; }
+        else m_encoding = Encoding::Utf8; // Per-line UTF-8 / Windows-1252 detection
+        append(probe.data() + skip, probe.size() - skip);
+        return;
+    }
+    if (m_encoding == Encoding::Utf8) {
+        appendUtf8(data, length);
+        return;
+    }
+
+    // UTF-16: an odd trailing byte waits in m_carry for its partner
+    std::string utf8;
+    utf8.reserve(length);
+    m_carry.append(data, length);
+    size_t i = 0;
+    for (; i + 1 < m_carry.size(); i += 2) {
+        unsigned char a = (unsigned char)m_carry[i], b = (unsigned char)m_carry[i + 1];
+        uint32_t unit = m_encoding == Encoding::Utf16LE ? (uint32_t)(a | b << 8) : (uint32_t)(a << 8 | b);
+        if (unit >= 0xD800 && unit < 0xDC00) {
+            m_highSurrogate = unit;
+            continue;
+        }
+        if (unit >= 0xDC00 && unit < 0xE000) {
+            appendCodePoint(utf8, m_highSurrogate ? 0x10000 + ((m_highSurrogate - 0xD800) << 10) + (unit - 0xDC00) : 0xFFFD);
+        } else {
+            if (m_highSurrogate) appendCodePoint(utf8, 0xFFFD);
+            appendCodePoint(utf8, unit);
+        }
+        m_highSurrogate = 0;
+    }
+    m_carry.erase(0, i);
+    appendUtf8(utf8.data(), utf8.size());
+}
+
+void SrtToVtt::appendUtf8(const char* data, size_t length) {
+    const char* end = data + length;
+    while (data < end) {
+        const char* newline = std::find(data, end, '\n');
+        m_pending.append(data, newline);
+        if (newline == end) break;
+        line(std::move(m_pending));
+        m_pending.clear();
+        data = newline + 1;
+    }
+}
+
+void SrtToVtt::line(std::string text) {
+    if (!text.empty() && text.back() == '\r') text.pop_back();
+    if (!isValidUtf8(text)) text = fromWindows1252(text);
+
+    if (m_lines++ == 0) {
+        m_passthrough = text.rfind("WEBVTT", 0) == 0;
+        if (!m_passthrough) m_output += "WEBVTT\n\n";
+    }
+    if (m_passthrough) {
+        m_output += text;
+        m_output += '\n';
+        return;
+    }
+
+    if (trim(text).empty()) {
+        // Cues end at a blank line; collapse runs of them
+        if (!m_blank) m_output += '\n';
+        m_blank = true;
+        return;
+    }
+
+    size_t arrow = text.find("-->");
+    if (arrow != std::string::npos) {
+        std::string start, end;
+        std::string right = trim(text.substr(arrow + 3));
+        // SRT may append "X1:40 X2:600 Y1:20 Y2:50" after the end time
+        right = right.substr(0, right.find_first_of(" \t"));
+        if (normalizeTimestamp(trim(text.substr(0, arrow)), start) && normalizeTimestamp(right, end)) {
+            m_output += start + " --> " + end + "\n";
+            m_blank = false;
+            return;
+        }
+    }
+    m_output += cleanCueText(text);
+    m_output += '\n';
+    m_blank = false;
+}
+
+std::string SrtToVtt::finish() {
+    if (m_encoding == Encoding::Unknown) {
+        std::string probe;
+        probe.swap(m_pending);
+        m_encoding = Encoding::Utf8;
+        if (probe.compare(0, 2, "\xFF\xFE") == 0) { m_encoding = Encoding::Utf16LE; probe.erase(0, 2); }
+        else if (probe.compare(0, 2, "\xFE\xFF") == 0) { m_encoding = Encoding::Utf16BE; probe.erase(0, 2); }
+        append(probe.data(), probe.size());
+    }
+    if (!m_pending.empty()) {
+        line(std::move(m_pending));
+        m_pending.clear();
+    }
+    if (m_lines == 0) m_output += "WEBVTT\n\n";
+    return std::move(m_output);
+}
+
+std::string SrtToVtt::convert(const std::string& srt) {
+    SrtToVtt converter;
+    converter.append(srt.data(), srt.size());
+    return converter.finish();
+}
+
+std::vector<SubtitleTrack> findSubtitles(const fs::path& video) {
+    std::vector<SubtitleTrack> tracks;
+    std::string stem = video.stem().string();
+    std::error_code ec;
+    for (fs::directory_iterator it(video.parent_path(), ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        std::string ext = it->path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if ((ext != ".srt" && ext != ".vtt") || name.size() <= stem.size() || name.compare(0, stem.size(), stem) != 0 ||
+            name[stem.size()] != '.') {
+            continue;
+        }
+
+        SubtitleTrack track;
+        track.file = name;
+        // movie.en.forced.srt -> "en.forced"
+        std::string rest = name.substr(stem.size()); // ".en.forced.srt" or ".srt"
+        std::string middle = rest.size() > ext.size() + 1 ? rest.substr(1, rest.size() - ext.size() - 1) : "";
+        track.label = middle.empty() ? "Subtitles" : middle;
+        std::string first = middle.substr(0, middle.find('.'));
+        if (looksLikeLanguage(first)) track.language = first;
+        tracks.push_back(std::move(track));
+    }
+    // The untagged movie.srt first (it becomes the default track), then by name
+    std::sort(tracks.begin(), tracks.end(), [&stem](const SubtitleTrack& a, const SubtitleTrack& b) {
+        bool aPlain = a.file.size() == stem.size() + 4, bPlain = b.file.size() == stem.size() + 4;
+        return aPlain != bPlain ? aPlain : a.file < b.file;
+    });
+    return tracks;
+}
+
+SubtitleCache::SubtitleCache(size_t maxBytes) : m_bytes(0), m_maxBytes(maxBytes) {}
+
+std::shared_ptr<const std::string> SubtitleCache::webVtt(const fs::path& source, std::string& validator) {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(source, ec);
+    uintmax_t size = ec ? 0 : fs::file_size(source, ec);
+    if (ec) return nullptr;
+    std::string key = source.string() + '|' + std::to_string(mtime.time_since_epoch().count()) + '|' + std::to_string(size);
+    char etag[32];
+    std::snprintf(etag, sizeof(etag), "\"v%016zx\"", std::hash<std::string>{}(key));
+    validator = etag;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return it->second->data;
+        }
+    }
+
+    // Convert outside the lock; two threads racing on the same miss is harmless
+    std::ifstream in(source, std::ios::binary);
+    if (!in) return nullptr;
+    SrtToVtt converter;
+    char buffer[16 * 1024];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) converter.append(buffer, (size_t)in.gcount());
+    auto vtt = std::make_shared<const std::string>(converter.finish());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_index.find(key) == m_index.end() && vtt->size() + key.size() <= m_maxBytes) {
+        m_lru.push_front(Entry{key, vtt});
+        m_index[key] = m_lru.begin();
+        m_bytes += vtt->size() + key.size();
+        while (m_bytes > m_maxBytes && !m_lru.empty()) {
+            m_bytes -= m_lru.back().data->size() + m_lru.back().key.size();
+            m_index.erase(m_lru.back().key);
+            m_lru.pop_back();
+        }
+    }
+    return vtt;
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+namespace Server {
+
+// Streaming SubRip -> WebVTT conversion.
+//
+// Input may arrive in arbitrary chunks. Encoding is detected from the BOM
+// (UTF-8, UTF-16 LE/BE); without one each line is kept if it is valid UTF-8
+// and otherwise decoded as Windows-1252, which covers most legacy .srt files.
+// Timestamps are rewritten to HH:MM:SS.mmm, SRT position suffixes and
+// ASS-style {\...} overrides are dropped, and <font> tags are stripped.
+class SrtToVtt {
+public:
+    SrtToVtt();
+
+    void append(const char* data, size_t length);
+    // Flushes the last partial line and returns the complete document
+    std::string finish();
+
+    static std::string convert(const std::string& srt);
+
+private:
+    enum class Encoding { Unknown, Utf8, Utf16LE, Utf16BE };
+
+    void appendUtf8(const char* data, size_t length);
+    void line(std::string text);
+
+    Encoding m_encoding;
+    std::string m_pending;   // Bytes of an incomplete line (or BOM probe)
+    std::string m_carry;     // Odd trailing byte of UTF-16 input
+    std::string m_output;
+    uint32_t m_highSurrogate;
+    size_t m_lines;
+    bool m_passthrough;      // Input is already WebVTT
+    bool m_blank;            // Last emitted line was empty
+};
+
+// One subtitle file next to a video
+struct SubtitleTrack {
+    std::string file;     // Sibling file name
+    std::string label;    // "English", "en.forced", or "Subtitles" for movie.srt
+    std::string language; // BCP 47-ish tag when the name carries one, else empty
+};
+
+// movie.srt, movie.en.srt, movie.English.vtt ... for movie.mp4; an untagged file
+// comes first, the rest are sorted by name
+std::vector<SubtitleTrack> findSubtitles(const std::filesystem::path& video);
+
+// Converted WebVTT documents in memory, keyed by path + mtime + size, so a
+// subtitle is converted once per change rather than once per request.
+class SubtitleCache {
+public:
+    explicit SubtitleCache(size_t maxBytes = 8 * 1024 * 1024);
+
+    // WebVTT for an .srt (converted) or .vtt (re-encoded as UTF-8) file.
+    // validator is set to a strong ETag. nullptr when the file cannot be read.
+    std::shared_ptr<const std::string> webVtt(const std::filesystem::path& source, std::string& validator);
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const std::string> data;
+    };
+
+    std::mutex m_mutex;
+    std::list<Entry> m_lru; // Front = most recently used
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t m_bytes;
+    size_t m_maxBytes;
+};
+
+}
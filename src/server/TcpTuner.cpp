@@ -0,0 +1,125 @@
+#include "TcpTuner.hpp"
+#include <algorithm>
+#include <cstddef>
+
+#ifdef __linux__
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <linux/tcp.h>
+#elif !defined(_WIN32)
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+#endif
+
+namespace Server {
+
+static constexpr auto kSampleInterval = std::chrono::milliseconds(200);
+static constexpr int kMinSendBuffer = 64 * 1024;
+static constexpr int kMaxSendBuffer = 4 * 1024 * 1024;
+static constexpr size_t kMinChunk = 64 * 1024;
+static constexpr size_t kMaxChunk = 1024 * 1024;
+
+#ifdef _WIN32
+TcpTuner::TcpTuner(SOCKET socket)
+#else
+TcpTuner::TcpTuner(int socket)
+#endif
+    : m_socket(socket), m_lastSample(std::chrono::steady_clock::now()),
+      m_lastRetrans(0), m_lastSegsOut(0), m_cleanSamples(0) {
+    // OPTIMIZATION: Enable TCP_NODELAY to disable Nagle's algorithm for lower latency
+    int flag = 1;
+    setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+
+#ifdef __linux__
+    // Start small and grow with the measured BDP; a phone on weak WiFi
+    // never needs the megabyte a wired TV does
+    setSendBuffer(256 * 1024);
+    m_tuning.chunkSize = 128 * 1024;
+#else
+    // No TCP_INFO to adapt from: keep the fixed 1MB kernel buffer
+    setSendBuffer(1024 * 1024);
+    m_tuning.chunkSize = kMinChunk;
+#endif
+}
+
+void TcpTuner::onSent(size_t bytes) {
+    (void)bytes;
+#ifdef __linux__
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_lastSample < kSampleInterval) return;
+    m_lastSample = now;
+    sample();
+#endif
+}
+
+void TcpTuner::sample() {
+#ifdef __linux__
+    struct tcp_info info = {};
+    socklen_t len = sizeof(info);
+    if (getsockopt(m_socket, IPPROTO_TCP, TCP_INFO, &info, &len) != 0) return;
+
+    // Older kernels return a shorter struct; only trust fields they filled in
+    auto has = [len](size_t offset, size_t size) { return len >= offset + size; };
+
+    m_tuning.rttUs = info.tcpi_rtt;
+    m_tuning.cwnd = info.tcpi_snd_cwnd;
+    m_tuning.mss = info.tcpi_snd_mss;
+    m_tuning.totalRetrans = info.tcpi_total_retrans;
+    m_tuning.minRttUs = has(offsetof(tcp_info, tcpi_min_rtt), sizeof(info.tcpi_min_rtt)) ? info.tcpi_min_rtt : info.tcpi_rtt;
+    m_tuning.deliveryRate = has(offsetof(tcp_info, tcpi_delivery_rate), sizeof(info.tcpi_delivery_rate)) ? info.tcpi_delivery_rate : 0;
+
+    // Bandwidth-delay product: what must be in flight to keep the path busy
+    uint64_t bdp;
+    if (m_tuning.deliveryRate > 0 && m_tuning.rttUs > 0) {
+        bdp = m_tuning.deliveryRate * m_tuning.rttUs / 1000000;
+    } else {
+        bdp = (uint64_t)m_tuning.cwnd * m_tuning.mss;
+    }
+
+    // Twice the BDP absorbs rate/RTT jitter; more only queues data that a
+    // seek then has to wait behind
+    int targetBuffer = (int)std::clamp<uint64_t>(bdp * 2, kMinSendBuffer, kMaxSendBuffer);
+    if (targetBuffer > m_tuning.sendBuffer * 5 / 4 || targetBuffer < m_tuning.sendBuffer * 3 / 4) {
+        setSendBuffer(targetBuffer);
+    }
+
+    size_t chunk = (size_t)std::clamp<uint64_t>(bdp, kMinChunk, kMaxChunk);
+    m_tuning.chunkSize = (chunk + kMinChunk - 1) / kMinChunk * kMinChunk;
+
+    // Retransmission ratio since the last sample decides pacing
+    uint32_t segsOut = has(offsetof(tcp_info, tcpi_segs_out), sizeof(info.tcpi_segs_out)) ? info.tcpi_segs_out : 0;
+    uint32_t dRetrans = m_tuning.totalRetrans - m_lastRetrans;
+    uint32_t dSegs = segsOut - m_lastSegsOut;
+    m_lastRetrans = m_tuning.totalRetrans;
+    m_lastSegsOut = segsOut;
+
+    bool lossy = dSegs >= 50 && (uint64_t)dRetrans * 100 > (uint64_t)dSegs * 2;
+    if (lossy && m_tuning.deliveryRate > 0) {
+        // Bursts above the delivery rate are what a weak WiFi link drops
+        m_cleanSamples = 0;
+        setPacingRate(m_tuning.deliveryRate * 5 / 4);
+    } else if (dRetrans == 0 && m_tuning.pacingRate != 0 && ++m_cleanSamples >= 10) {
+        setPacingRate(0);
+    }
+#endif
+}
+
+void TcpTuner::setSendBuffer(int bytes) {
+    if (setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, (char*)&bytes, sizeof(bytes)) == 0) {
+        m_tuning.sendBuffer = bytes;
+    }
+}
+
+void TcpTuner::setPacingRate(uint64_t bytesPerSecond) {
+#if defined(__linux__) && defined(SO_MAX_PACING_RATE)
+    unsigned int rate = bytesPerSecond == 0 ? ~0U : (unsigned int)std::min<uint64_t>(bytesPerSecond, ~0U - 1);
+    if (setsockopt(m_socket, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0) {
+        m_tuning.pacingRate = bytesPerSecond;
+    }
+#else
+    (void)bytesPerSecond;
+#endif
+}
+
+}
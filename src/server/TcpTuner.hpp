@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+#endif
+
+namespace Server {
+
+// Last TCP_INFO sample and the per-connection settings derived from it
+struct TcpTuning {
+    uint32_t rttUs = 0;
+    uint32_t minRttUs = 0;
+    uint32_t cwnd = 0;              // Segments
+    uint32_t mss = 0;
+    uint32_t totalRetrans = 0;
+    uint64_t deliveryRate = 0;      // Bytes/s as estimated by the kernel
+    int sendBuffer = 0;             // SO_SNDBUF requested from the kernel
+    size_t chunkSize = 0;           // Bytes handed to one send/sendfile call
+    uint64_t pacingRate = 0;        // SO_MAX_PACING_RATE in bytes/s, 0 = unpaced
+};
+
+// Sizes the socket send buffer and send chunks to the path's measured
+// bandwidth-delay product instead of a fixed 1MB for every client, and paces
+// lossy (weak WiFi) clients at their delivery rate. Linux only; elsewhere it
+// keeps the previous fixed settings.
+class TcpTuner {
+public:
+#ifdef _WIN32
+    explicit TcpTuner(SOCKET socket);
+#else
+    explicit TcpTuner(int socket);
+#endif
+
+    // Call after each chunk; samples TCP_INFO at most every kSampleInterval
+    void onSent(size_t bytes);
+
+    size_t chunkSize() const { return m_tuning.chunkSize; }
+    const TcpTuning& tuning() const { return m_tuning; }
+
+private:
+    void sample();
+    void setSendBuffer(int bytes);
+    void setPacingRate(uint64_t bytesPerSecond);
+
+#ifdef _WIN32
+    SOCKET m_socket;
+#else
+    int m_socket;
+#endif
+    TcpTuning m_tuning;
+    std::chrono::steady_clock::time_point m_lastSample;
+    uint32_t m_lastRetrans;
+    uint32_t m_lastSegsOut;
+    int m_cleanSamples;
+};
+
+}
@@ -0,0 +1,184 @@
+#include "ThumbnailCache.hpp"
+#include <algorithm>
+#include <vector>
+#include <QCryptographicHash>
+#include <QImage>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+
+namespace fs = std::filesystem;
+
+namespace Server {
+
+static QString toQString(const fs::path& path) {
+    return QString::fromStdU16String(path.u16string());
+}
+
+ThumbnailCache::ThumbnailCache()
+    : m_cacheDir(fs::temp_directory_path() / "localwaves-thumbs"), m_pool(new QThreadPool),
+      m_cacheBytes(0), m_pruneQueued(false) {
+    // Full-size decodes are memory hungry: a few at a time is plenty
+    m_pool->setMaxThreadCount(std::max(2, QThread::idealThreadCount() / 2));
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    m_pool->waitForDone();
+}
+
+void ThumbnailCache::setCacheDir(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cacheDir = dir.empty() ? fs::temp_directory_path() / "localwaves-thumbs" : fs::path(dir);
+    schedulePruneLocked(); // Set on every server start
+}
+
+std::string ThumbnailCache::cacheDir() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cacheDir.string();
+}
+
+bool ThumbnailCache::isImage(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".gif" ||
+           ext == ".webp" || ext == ".bmp";
+}
+
+int ThumbnailCache::snapSize(int requested) {
+    if (requested <= 128) return 128;
+    if (requested <= 256) return 256;
+    return 512;
+}
+
+fs::path ThumbnailCache::thumbnail(const fs::path& source, int size, std::string& validator) {
+    std::error_code ec;
+    uintmax_t fileSize = fs::file_size(source, ec);
+    if (ec) return {};
+    auto mtime = fs::last_write_time(source, ec);
+    if (ec) return {};
+
+    size = snapSize(size);
+    std::string identity = source.string() + "|" + std::to_string(mtime.time_since_epoch().count()) + "|" +
+                           std::to_string(fileSize) + "|" + std::to_string(size);
+    std::string key = QCryptographicHash::hash(QByteArray::fromStdString(identity), QCryptographicHash::Sha1)
+                          .toHex().toStdString();
+    validator = "\"t-" + key.substr(0, 16) + "\"";
+
+    std::shared_future<fs::path> job;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Two-level fan-out keeps directories small on big libraries
+        fs::path base = m_cacheDir / key.substr(0, 2) / key;
+        for (const char* ext : {".jpg", ".png"}) {
+            fs::path cached = base;
+            cached += ext;
+            auto used = fs::last_write_time(cached, ec);
+            if (ec) continue;
+            // mtime doubles as "last used" for pruning; refreshed at most daily
+            auto now = fs::file_time_type::clock::now();
+            if (now - used > std::chrono::hours(24)) fs::last_write_time(cached, now, ec);
+            return cached;
+        }
+
+        auto it = m_inFlight.find(key);
+        if (it != m_inFlight.end()) {
+            job = it->second;
+        } else {
+            auto promise = std::make_shared<std::promise<fs::path>>();
+            job = promise->get_future().share();
+            m_inFlight.emplace(key, job);
+            m_pool->start([this, promise, source, size, base, key] {
+                fs::path result = generate(source, size, base);
+                promise->set_value(result);
+                std::error_code ec;
+                uintmax_t bytes = result.empty() ? 0 : fs::file_size(result, ec);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_inFlight.erase(key);
+                if (!ec) m_cacheBytes += bytes;
+                if (m_cacheBytes > kMaxBytes) schedulePruneLocked();
+            });
+        }
+    }
+    return job.get();
+}
+
+fs::path ThumbnailCache::generate(const fs::path& source, int size, const fs::path& target) {
+    QImageReader reader(toQString(source));
+    reader.setAutoTransform(true); // Honour EXIF orientation
+
+    // OPTIMIZATION: Ask the decoder for the small size directly. JPEG can
+    // then decode at 1/2..1/8 scale, which skips most of the IDCT work.
+    QSize original = reader.size();
+    if (original.isValid() && (original.width() > size || original.height() > size)) {
+        reader.setScaledSize(original.scaled(size, size, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) return {};
+    if (image.width() > size || image.height() > size) { // Format ignored the scaled size
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    bool alpha = image.hasAlphaChannel();
+    fs::path output = target;
+    output += alpha ? ".png" : ".jpg";
+
+    std::error_code ec;
+    fs::create_directories(output.parent_path(), ec);
+    // Written to a temp file and renamed, so readers never see a partial image
+    QSaveFile file(toQString(output));
+    if (!file.open(QIODevice::WriteOnly)) return {};
+    if (!image.save(&file, alpha ? "PNG" : "JPEG", alpha ? -1 : 80) || !file.commit()) return {};
+    return output;
+}
+
+void ThumbnailCache::schedulePruneLocked() {
+    if (m_pruneQueued) return;
+    m_pruneQueued = true;
+    m_pool->start([this] { prune(); });
+}
+
+void ThumbnailCache::prune() {
+    fs::path dir;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pruneQueued = false;
+        dir = m_cacheDir;
+    }
+
+    struct CachedFile {
+        fs::path path;
+        fs::file_time_type used;
+        uintmax_t size;
+    };
+    std::vector<CachedFile> files;
+    uint64_t total = 0;
+    auto now = fs::file_time_type::clock::now();
+    std::error_code walkError, ec;
+    for (fs::recursive_directory_iterator it(dir, walkError), end; !walkError && it != end; it.increment(walkError)) {
+        if (!it->is_regular_file(ec)) continue;
+        CachedFile file{it->path(), it->last_write_time(ec), it->file_size(ec)};
+        if (ec) { ec.clear(); continue; }
+        if (now - file.used > kMaxIdle) {
+            fs::remove(file.path, ec);
+            continue;
+        }
+        total += file.size;
+        files.push_back(std::move(file));
+    }
+
+    if (total > kMaxBytes) {
+        std::sort(files.begin(), files.end(), [](const CachedFile& a, const CachedFile& b) { return a.used < b.used; });
+        for (const CachedFile& file : files) {
+            if (total <= kMaxBytes / 4 * 3) break;
+            if (fs::remove(file.path, ec)) total -= file.size;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cacheBytes = total;
+}
+
+}
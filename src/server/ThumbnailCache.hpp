@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <filesystem>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+class QThreadPool;
+
+namespace Server {
+
+// Downscaled previews for the gallery view, stored on disk.
+//
+// A thumbnail's file name is a hash of source path, mtime, size and target
+// edge, so a changed photo simply gets a new entry and lookups never need an
+// index. Decoding runs on a small dedicated pool: connection threads wait
+// for the result, but the number of concurrent full-size decodes (CPU and
+// memory heavy) stays bounded, and requests for the same image share one job.
+//
+// Entries of deleted or changed photos are never looked up again, so the
+// folder is pruned in the background: when a cache dir is set and whenever
+// new thumbnails push it past kMaxBytes. Entries unused for kMaxIdle go, then
+// the least recently used ones until it is back under three quarters.
+class ThumbnailCache {
+public:
+    static constexpr uint64_t kMaxBytes = 256ull * 1024 * 1024;
+    static constexpr std::chrono::hours kMaxIdle{24 * 30};
+
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    // Where thumbnails are kept; defaults to a folder in the system temp dir
+    void setCacheDir(const std::string& dir);
+    std::string cacheDir() const;
+
+    static bool isImage(const std::filesystem::path& path);
+    // Clamps a requested size to the few edges that are actually generated
+    static int snapSize(int requested);
+
+    // Path of the cached thumbnail (JPEG, or PNG when the source has alpha).
+    // Generates it on a miss. Empty when the source cannot be decoded.
+    // validator is set to a strong ETag for the result.
+    std::filesystem::path thumbnail(const std::filesystem::path& source, int size, std::string& validator);
+
+private:
+    std::filesystem::path generate(const std::filesystem::path& source, int size, const std::filesystem::path& target);
+    // Queues prune() unless one is queued already; m_mutex must be held
+    void schedulePruneLocked();
+    void prune();
+
+    mutable std::mutex m_mutex;
+    std::filesystem::path m_cacheDir;
+    std::unique_ptr<QThreadPool> m_pool;
+    std::unordered_map<std::string, std::shared_future<std::filesystem::path>> m_inFlight;
+    uint64_t m_cacheBytes;   // As of the last prune, plus what was generated since
+    bool m_pruneQueued;
+};
+
+}
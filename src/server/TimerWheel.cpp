@@ -0,0 +1,115 @@
+#include "TimerWheel.hpp"
+
+namespace Server {
+
+TimerWheel::TimerWheel() : m_tick(0), m_pending(0), m_running(false) {
+    for (auto& level : m_slots) {
+        for (Timer& head : level) head.prev = head.next = &head;
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+void TimerWheel::start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) return;
+    m_running = true;
+    m_thread = std::thread(&TimerWheel::run, this);
+}
+
+void TimerWheel::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) return;
+        m_running = false;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void TimerWheel::arm(Timer& timer, uint32_t delayMs, const char* tag) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (timer.next) unlink(timer);
+    else ++m_pending;
+    // Round up, and never into the tick that was already processed
+    uint64_t ticks = (delayMs + kTickMs - 1) / kTickMs;
+    timer.expiry = m_tick + (ticks ? ticks : 1);
+    timer.tag = tag;
+    insert(timer);
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!timer.next) return;
+    unlink(timer);
+    --m_pending;
+}
+
+int TimerWheel::pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+void TimerWheel::insert(Timer& timer) {
+    const uint64_t maxDelta = (1ull << (kSlotBits * kLevels)) - 1;
+    if (timer.expiry - m_tick > maxDelta) timer.expiry = m_tick + maxDelta;
+    uint64_t delta = timer.expiry - m_tick;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (1ull << (kSlotBits * (level + 1)))) ++level;
+    Timer& head = m_slots[level][(timer.expiry >> (kSlotBits * level)) & (kSlots - 1)];
+
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = nullptr;
+}
+
+void TimerWheel::advance() {
+    ++m_tick;
+
+    // Highest level whose slot boundary this tick crosses, then cascade down
+    int top = 0;
+    while (top < kLevels - 1 && (m_tick & ((1ull << (kSlotBits * (top + 1))) - 1)) == 0) ++top;
+    for (int level = top; level >= 1; --level) {
+        Timer& head = m_slots[level][(m_tick >> (kSlotBits * level)) & (kSlots - 1)];
+        while (head.next != &head) {
+            Timer& timer = *head.next;
+            unlink(timer);
+            insert(timer);
+        }
+    }
+
+    Timer& head = m_slots[0][m_tick & (kSlots - 1)];
+    while (head.next != &head) {
+        Timer& timer = *head.next;
+        unlink(timer);
+        --m_pending;
+        if (timer.onExpire) timer.onExpire();
+    }
+}
+
+void TimerWheel::run() {
+    const auto tick = std::chrono::milliseconds(kTickMs);
+    auto next = std::chrono::steady_clock::now() + tick;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        if (m_cv.wait_until(lock, next, [this] { return !m_running; })) break;
+        // Catch up if the thread was descheduled for several ticks
+        auto now = std::chrono::steady_clock::now();
+        while (next <= now) {
+            advance();
+            next += tick;
+        }
+    }
+}
+
+}
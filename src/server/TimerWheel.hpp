@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Server {
+
+// Hierarchical timer wheel for per-connection deadlines.
+//
+// Four levels of 64 slots at a 100ms tick cover ~20 days. Timers are
+// intrusive list nodes owned by the caller, so arm and cancel are O(1) and
+// never allocate. One background thread advances the wheel; a timer in a
+// higher level is cascaded down once its slot comes around.
+//
+// Callbacks run on the wheel thread with the wheel lock held, so they must
+// be short (e.g. shutdown() a socket) and must not arm or cancel timers.
+// In exchange, once cancel() returns the callback is guaranteed not to be
+// running, which makes it safe to destroy the owner.
+class TimerWheel {
+public:
+    static constexpr uint32_t kTickMs = 100;
+
+    struct Timer {
+        std::function<void()> onExpire;
+        const char* tag = "";     // Set by arm(); readable from onExpire
+
+    private:
+        friend class TimerWheel;
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t expiry = 0;      // Absolute tick
+    };
+
+    TimerWheel();
+    ~TimerWheel();
+
+    void start();
+    void stop();
+
+    // (Re)arms timer to fire after at least delayMs; tag names the deadline
+    void arm(Timer& timer, uint32_t delayMs, const char* tag);
+    void cancel(Timer& timer);
+
+    int pending() const;
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr int kSlots = 1 << kSlotBits;
+
+    void insert(Timer& timer);
+    static void unlink(Timer& timer);
+    void advance();
+    void run();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Timer m_slots[kLevels][kSlots]; // Sentinels of circular lists
+    uint64_t m_tick;
+    int m_pending;
+    bool m_running;
+    std::thread m_thread;
+};
+
+}
@@ -0,0 +1,241 @@
+#include "TlsContext.hpp"
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <random>
+#include <cstdio>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#ifdef LOCALWAVES_HAS_OPENSSL
+    #include <openssl/ssl.h>
+    #include <openssl/err.h>
+    #include <openssl/evp.h>
+    #include <openssl/pem.h>
+    #include <openssl/x509v3.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Server {
+
+#ifdef LOCALWAVES_HAS_OPENSSL
+
+static std::string lastSslError() {
+    unsigned long code = ERR_get_error();
+    if (code == 0) return "unknown error";
+    char buf[256];
+    ERR_error_string_n(code, buf, sizeof(buf));
+    return buf;
+}
+
+static bool generateSelfSigned(const std::string& certPath, const std::string& keyPath,
+                               const std::vector<std::string>& altNames, std::string& error) {
+    // P-256 keeps the handshake cheap on phones; AES-GCM suites are kTLS friendly
+    EVP_PKEY* pkey = EVP_EC_gen("P-256");
+    X509* x509 = X509_new();
+    if (!pkey || !x509) {
+        error = "Key generation failed: " + lastSslError();
+        EVP_PKEY_free(pkey);
+        X509_free(x509);
+        return false;
+    }
+
+    std::random_device rd;
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), static_cast<long>(rd() & 0x7fffffff));
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 60L * 60 * 24 * 825); // Max lifetime browsers accept
+    X509_set_pubkey(x509, pkey);
+
+    X509_NAME* name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"LocalWaves", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+
+    std::ostringstream san;
+    san << "DNS:localhost,IP:127.0.0.1";
+    for (const auto& alt : altNames) {
+        bool isIp = alt.find_first_not_of("0123456789.:") == std::string::npos;
+        san << "," << (isIp ? "IP:" : "DNS:") << alt;
+    }
+
+    X509V3_CTX v3;
+    X509V3_set_ctx_nodb(&v3);
+    X509V3_set_ctx(&v3, x509, x509, nullptr, nullptr, 0);
+    X509_EXTENSION* ext = X509V3_EXT_conf_nid(nullptr, &v3, NID_subject_alt_name, san.str().c_str());
+    if (ext) {
+        X509_add_ext(x509, ext, -1);
+        X509_EXTENSION_free(ext);
+    }
+
+    bool ok = X509_sign(x509, pkey, EVP_sha256()) > 0;
+    if (!ok) error = "Certificate signing failed: " + lastSslError();
+
+    if (ok) {
+        std::error_code ec;
+        fs::path certDir = fs::path(certPath).parent_path();
+        fs::path keyDir = fs::path(keyPath).parent_path();
+        if (!certDir.empty()) fs::create_directories(certDir, ec);
+        if (!keyDir.empty()) fs::create_directories(keyDir, ec);
+
+        // The key is never readable by others, not even between create and chmod.
+        // A leftover key (its certificate went missing) is replaced, not reused.
+#ifdef _WIN32
+        FILE* keyFile = fopen(keyPath.c_str(), "wb");
+#else
+        FILE* keyFile = nullptr;
+        fs::remove(keyPath, ec);
+        int keyFd = open(keyPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (keyFd >= 0) {
+            keyFile = fdopen(keyFd, "wb");
+            if (!keyFile) close(keyFd);
+        }
+#endif
+        FILE* certFile = fopen(certPath.c_str(), "wb");
+        ok = keyFile && certFile
+            && PEM_write_PrivateKey(keyFile, pkey, nullptr, nullptr, 0, nullptr, nullptr)
+            && PEM_write_X509(certFile, x509);
+        if (keyFile) fclose(keyFile);
+        if (certFile) fclose(certFile);
+
+        if (!ok) error = "Failed to write certificate to " + certPath;
+    }
+
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+    return ok;
+}
+
+TlsContext::TlsContext() : m_ctx(nullptr) {}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(m_ctx);
+}
+
+bool TlsContext::init(const std::string& certPath, const std::string& keyPath,
+                      const std::vector<std::string>& altNames, std::string& error) {
+    SSL_CTX_free(m_ctx);
+    m_ctx = nullptr;
+
+    if (!fs::exists(certPath) || !fs::exists(keyPath)) {
+        if (!generateSelfSigned(certPath, keyPath, altNames, error)) return false;
+    }
+
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        error = "SSL_CTX_new failed: " + lastSslError();
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    // Let OpenSSL install the negotiated keys into the kernel (TCP_ULP "tls")
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+
+    // Prefer AES-GCM: the kernel offloads it (and NICs with TLS offload do too),
+    // ChaCha20 is kept last for clients without AES hardware
+    SSL_CTX_set_ciphersuites(ctx, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256");
+    SSL_CTX_set_cipher_list(ctx, "ECDHE+AESGCM:ECDHE+CHACHA20");
+
+    // Session tickets are written after the handshake and would be the only
+    // user-space records on the socket; LAN clients reconnect cheaply anyway
+    SSL_CTX_set_num_tickets(ctx, 0);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, certPath.c_str()) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(ctx, keyPath.c_str(), SSL_FILETYPE_PEM) <= 0 ||
+        !SSL_CTX_check_private_key(ctx)) {
+        error = "Failed to load certificate/key: " + lastSslError();
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    m_ctx = ctx;
+    return true;
+}
+
+bool TlsContext::kernelTlsAvailable() {
+#ifdef __linux__
+    std::ifstream ulp("/proc/sys/net/ipv4/tcp_available_ulp");
+    std::string name;
+    while (ulp >> name) {
+        if (name == "tls") return true;
+    }
+#endif
+    return false;
+}
+
+#ifdef _WIN32
+TlsSession::TlsSession(TlsContext& ctx, SOCKET socket)
+#else
+TlsSession::TlsSession(TlsContext& ctx, int socket)
+#endif
+    : m_ssl(SSL_new(ctx.native())), m_kernelSend(false) {
+    if (m_ssl) SSL_set_fd(m_ssl, static_cast<int>(socket));
+}
+
+TlsSession::~TlsSession() {
+    if (m_ssl) {
+        SSL_shutdown(m_ssl);
+        SSL_free(m_ssl);
+    }
+}
+
+bool TlsSession::handshake() {
+    if (!m_ssl || SSL_accept(m_ssl) <= 0) {
+        ERR_clear_error();
+        return false;
+    }
+#ifndef OPENSSL_NO_KTLS
+    m_kernelSend = BIO_get_ktls_send(SSL_get_wbio(m_ssl)) != 0;
+#endif
+    return true;
+}
+
+int TlsSession::read(char* buffer, int length) {
+    int r = SSL_read(m_ssl, buffer, length);
+    if (r <= 0) ERR_clear_error();
+    return r;
+}
+
+int TlsSession::write(const char* data, int length) {
+    int r = SSL_write(m_ssl, data, length);
+    if (r <= 0) ERR_clear_error();
+    return r;
+}
+
+int64_t TlsSession::sendFile(int fd, int64_t offset, size_t length) {
+    ossl_ssize_t r = SSL_sendfile(m_ssl, fd, static_cast<off_t>(offset), length, 0);
+    if (r < 0) ERR_clear_error();
+    return r;
+}
+
+#else // !LOCALWAVES_HAS_OPENSSL
+
+TlsContext::TlsContext() : m_ctx(nullptr) {}
+TlsContext::~TlsContext() {}
+
+bool TlsContext::init(const std::string&, const std::string&,
+                      const std::vector<std::string>&, std::string& error) {
+    error = "Built without OpenSSL; HTTPS is not available";
+    return false;
+}
+
+bool TlsContext::kernelTlsAvailable() { return false; }
+
+#ifdef _WIN32
+TlsSession::TlsSession(TlsContext&, SOCKET) : m_ssl(nullptr), m_kernelSend(false) {}
+#else
+TlsSession::TlsSession(TlsContext&, int) : m_ssl(nullptr), m_kernelSend(false) {}
+#endif
+TlsSession::~TlsSession() {}
+bool TlsSession::handshake() { return false; }
+int TlsSession::read(char*, int) { return -1; }
+int TlsSession::write(const char*, int) { return -1; }
+int64_t TlsSession::sendFile(int, int64_t, size_t) { return -1; }
+
+#endif
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+#endif
+
+// Forward declarations so OpenSSL headers stay out of the rest of the server
+struct ssl_ctx_st;
+struct ssl_st;
+
+namespace Server {
+
+// Server-wide TLS state: certificate, key and the shared SSL_CTX.
+// Built without OpenSSL every call fails and the server stays plaintext.
+class TlsContext {
+public:
+    TlsContext();
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    // Loads the PEM certificate/key pair. When either file is missing a
+    // self-signed certificate (valid for altNames) is generated and saved there.
+    bool init(const std::string& certPath, const std::string& keyPath,
+              const std::vector<std::string>& altNames, std::string& error);
+
+    bool isReady() const { return m_ctx != nullptr; }
+    ssl_ctx_st* native() const { return m_ctx; }
+
+    // True when the kernel has the "tls" ULP loaded, i.e. kTLS can be used
+    static bool kernelTlsAvailable();
+
+private:
+    ssl_ctx_st* m_ctx;
+};
+
+// One TLS session on an accepted socket.
+// After the handshake OpenSSL hands the record layer to the kernel (kTLS)
+// when possible, which keeps sendFile() on the zero-copy path.
+class TlsSession {
+public:
+#ifdef _WIN32
+    TlsSession(TlsContext& ctx, SOCKET socket);
+#else
+    TlsSession(TlsContext& ctx, int socket);
+#endif
+    ~TlsSession();
+
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    bool handshake();
+    int read(char* buffer, int length);
+    int write(const char* data, int length);
+
+    // kTLS transmit offload active: encryption happens in the kernel
+    bool kernelSend() const { return m_kernelSend; }
+
+    // Sends [offset, offset + length) of fd through SSL_sendfile.
+    // Only valid when kernelSend() is true. Returns bytes sent or -1.
+    int64_t sendFile(int fd, int64_t offset, size_t length);
+
+private:
+    ssl_st* m_ssl;
+    bool m_kernelSend;
+};
+
+}
@@ -0,0 +1,153 @@
+#include "Trace.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace Server {
+
+namespace {
+
+constexpr size_t kSpansPerLane = 4096;  // ~128KB per lane
+constexpr size_t kMaxLanes = 256;       // Threads beyond this are not traced
+
+struct Span {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    uint64_t connection;
+};
+
+// One ring buffer, written by a single thread at a time
+struct Lane {
+    uint32_t id = 0;
+    std::atomic<uint64_t> head{0};
+    Span spans[kSpansPerLane];
+};
+
+std::atomic<uint32_t> g_sampleEvery{0};
+std::atomic<uint64_t> g_sampleCounter{0};
+std::atomic<uint64_t> g_clearedAt{0};
+const auto g_origin = std::chrono::steady_clock::now();
+
+std::mutex g_lanesMutex;
+std::vector<std::unique_ptr<Lane>> g_lanes; // Never freed: dumps may read them any time
+std::vector<Lane*> g_freeLanes;
+
+Lane* acquireLane() {
+    std::lock_guard<std::mutex> lock(g_lanesMutex);
+    if (!g_freeLanes.empty()) {
+        Lane* lane = g_freeLanes.back();
+        g_freeLanes.pop_back();
+        return lane;
+    }
+    if (g_lanes.size() >= kMaxLanes) return nullptr;
+    g_lanes.push_back(std::make_unique<Lane>());
+    g_lanes.back()->id = static_cast<uint32_t>(g_lanes.size());
+    return g_lanes.back().get();
+}
+
+struct ThreadState {
+    Lane* lane = nullptr;
+    bool sampled = false;
+    uint64_t connection = 0;
+
+    ~ThreadState() {
+        // Connection threads are short-lived: hand the lane (and its spans) on
+        if (lane) {
+            std::lock_guard<std::mutex> lock(g_lanesMutex);
+            g_freeLanes.push_back(lane);
+        }
+    }
+};
+
+thread_local ThreadState t_state;
+
+}
+
+void Tracer::setSampleEvery(uint32_t n) {
+    g_sampleEvery.store(n, std::memory_order_relaxed);
+}
+
+uint32_t Tracer::sampleEvery() {
+    return g_sampleEvery.load(std::memory_order_relaxed);
+}
+
+bool Tracer::shouldSample() {
+    uint32_t every = g_sampleEvery.load(std::memory_order_relaxed);
+    if (every == 0) return false;
+    return g_sampleCounter.fetch_add(1, std::memory_order_relaxed) % every == 0;
+}
+
+void Tracer::beginConnection(bool sampled, uint64_t connectionId) {
+    t_state.sampled = sampled;
+    t_state.connection = connectionId;
+}
+
+bool Tracer::active() {
+    return t_state.sampled;
+}
+
+uint64_t Tracer::nowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - g_origin).count();
+}
+
+void Tracer::record(const char* name, uint64_t startNs, uint64_t endNs) {
+    ThreadState& state = t_state;
+    if (!state.lane) {
+        state.lane = acquireLane();
+        if (!state.lane) { // Out of lanes: stop tracing this thread
+            state.sampled = false;
+            return;
+        }
+    }
+    Lane* lane = state.lane;
+    uint64_t head = lane->head.load(std::memory_order_relaxed);
+    lane->spans[head % kSpansPerLane] = Span{name, startNs, endNs, state.connection};
+    lane->head.store(head + 1, std::memory_order_release);
+}
+
+std::string Tracer::dumpChromeJson() {
+    uint64_t clearedAt = g_clearedAt.load(std::memory_order_relaxed);
+    std::ostringstream json;
+    json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+
+    std::lock_guard<std::mutex> lock(g_lanesMutex);
+    std::vector<Span> copy(kSpansPerLane);
+    for (const auto& lane : g_lanes) {
+        json << (first ? "" : ",")
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << lane->id
+             << ",\"args\":{\"name\":\"lane " << lane->id << "\"}}";
+        first = false;
+
+        uint64_t head = lane->head.load(std::memory_order_acquire);
+        uint64_t count = head < kSpansPerLane ? head : kSpansPerLane;
+        for (uint64_t i = head - count; i < head; ++i) copy[i % kSpansPerLane] = lane->spans[i % kSpansPerLane];
+
+        // Slots the writer lapped while we copied may be torn: skip them
+        uint64_t after = lane->head.load(std::memory_order_acquire);
+        uint64_t firstValid = after > kSpansPerLane ? after - kSpansPerLane + 1 : 0;
+
+        for (uint64_t i = head - count; i < head; ++i) {
+            if (i < firstValid) continue;
+            const Span& span = copy[i % kSpansPerLane];
+            if (span.start < clearedAt) continue;
+            json << ",{\"name\":\"" << span.name << "\",\"cat\":\"http\",\"ph\":\"X\",\"pid\":1,\"tid\":" << lane->id
+                 << ",\"ts\":" << span.start / 1000 << "." << (span.start / 100) % 10
+                 << ",\"dur\":" << (span.end - span.start) / 1000 << "." << ((span.end - span.start) / 100) % 10
+                 << ",\"args\":{\"conn\":" << span.connection << "}}";
+        }
+    }
+    json << "]}";
+    return json.str();
+}
+
+void Tracer::clear() {
+    g_clearedAt.store(nowNs(), std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace Server {
+
+// Low-overhead span tracing, dumped as Chrome/Perfetto trace JSON.
+//
+// Sampling is per connection: the accept loop asks shouldSample() once and
+// the connection thread calls beginConnection() with the answer. Unsampled
+// threads pay one thread-local flag check per TraceScope. Sampled spans go
+// into a per-thread ring buffer (no locks on the hot path); buffers are
+// recycled when connection threads exit, so the last few thousand spans of
+// each lane stay available for dumpChromeJson().
+class Tracer {
+public:
+    // 0 disables tracing, 1 traces every connection, N traces one in N
+    static void setSampleEvery(uint32_t n);
+    static uint32_t sampleEvery();
+    static bool shouldSample();
+
+    // Marks the calling thread as (not) traced on behalf of connection id
+    static void beginConnection(bool sampled, uint64_t connectionId);
+    static bool active();
+
+    static uint64_t nowNs();
+    static void record(const char* name, uint64_t startNs, uint64_t endNs);
+
+    // {"traceEvents":[...]} with one complete ("X") event per span
+    static std::string dumpChromeJson();
+    static void clear();
+};
+
+// Records [construction, destruction) as a span named name (a string literal).
+// Spans shorter than minDurationNs are dropped, which keeps per-chunk send
+// spans down to the ones that actually blocked.
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, uint64_t minDurationNs = 0)
+        : m_name(Tracer::active() ? name : nullptr),
+          m_start(m_name ? Tracer::nowNs() : 0),
+          m_minDuration(minDurationNs) {}
+
+    ~TraceScope() {
+        if (!m_name) return;
+        uint64_t end = Tracer::nowNs();
+        if (end - m_start >= m_minDuration) Tracer::record(m_name, m_start, end);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_start;
+    uint64_t m_minDuration;
+};
+
+}
@@ -0,0 +1,167 @@
+#include "TrafficCapture.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace Server {
+
+namespace {
+
+constexpr size_t kFlushBytes = 64 * 1024;
+constexpr auto kFlushInterval = std::chrono::seconds(1);
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+bool getVarint(const char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char byte = (unsigned char)*p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+void putString(std::string& out, const std::string& value) {
+    putVarint(out, value.size());
+    out += value;
+}
+
+bool getString(const char*& p, const char* end, std::string& value) {
+    uint64_t length;
+    if (!getVarint(p, end, length) || (uint64_t)(end - p) < length) return false;
+    value.assign(p, (size_t)length);
+    p += length;
+    return true;
+}
+
+}
+
+TrafficCapture::TrafficCapture() : m_file(nullptr), m_open(false) {}
+
+TrafficCapture::~TrafficCapture() {
+    close();
+}
+
+bool TrafficCapture::open(const std::string& path) {
+    close();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) return false;
+
+    m_start = m_lastFlush = std::chrono::steady_clock::now();
+    m_buffer.assign(kMagic, 8);
+    putVarint(m_buffer, (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count());
+    flushLocked();
+    m_open = true;
+    return true;
+}
+
+void TrafficCapture::close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_open = false;
+    if (!m_file) return;
+    flushLocked();
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+uint64_t TrafficCapture::nowUs() const {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void TrafficCapture::write(const Record& record) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file) return;
+    encode(record, m_buffer);
+    auto now = std::chrono::steady_clock::now();
+    if (m_buffer.size() >= kFlushBytes || now - m_lastFlush >= kFlushInterval) {
+        flushLocked();
+        m_lastFlush = now;
+    }
+}
+
+void TrafficCapture::flushLocked() {
+    if (m_buffer.empty()) return;
+    std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    std::fflush(m_file);
+    m_buffer.clear();
+}
+
+TrafficCapture::Method TrafficCapture::methodFromString(const std::string& method) {
+    if (method == "GET") return Method::Get;
+    if (method == "POST") return Method::Post;
+    if (method == "HEAD") return Method::Head;
+    return Method::Other;
+}
+
+std::string TrafficCapture::methodName(const Record& record) {
+    switch (record.method) {
+        case Method::Get: return "GET";
+        case Method::Post: return "POST";
+        case Method::Head: return "HEAD";
+        default: return record.otherMethod;
+    }
+}
+
+void TrafficCapture::encode(const Record& record, std::string& out) {
+    putVarint(out, record.startUs);
+    putVarint(out, record.connection);
+    out += (char)record.method;
+    putString(out, record.path);
+    putString(out, record.range);
+    putVarint(out, record.requestBytes);
+    putString(out, record.method == Method::Other ? record.otherMethod : std::string());
+    putString(out, record.acceptEncoding);
+    putString(out, record.ifNoneMatch);
+    putVarint(out, record.status);
+    putVarint(out, record.responseBytes);
+    putVarint(out, record.durationUs);
+}
+
+bool TrafficCapture::decode(const char*& p, const char* end, Record& record) {
+    const char* cursor = p;
+    uint64_t status;
+    if (!getVarint(cursor, end, record.startUs) || !getVarint(cursor, end, record.connection) || cursor >= end) return false;
+    record.method = (Method)std::min<uint8_t>((uint8_t)*cursor++, (uint8_t)Method::Other);
+    if (!getString(cursor, end, record.path) ||
+        !getString(cursor, end, record.range) ||
+        !getVarint(cursor, end, record.requestBytes) || !getString(cursor, end, record.otherMethod) ||
+        !getString(cursor, end, record.acceptEncoding) || !getString(cursor, end, record.ifNoneMatch) ||
+        !getVarint(cursor, end, status) ||
+        !getVarint(cursor, end, record.responseBytes) || !getVarint(cursor, end, record.durationUs)) {
+        return false;
+    }
+    record.status = (uint16_t)status;
+    p = cursor;
+    return true;
+}
+
+bool TrafficCapture::readFile(const std::string& path, std::vector<Record>& records, uint64_t* wallClockUs) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::string data;
+    char buffer[64 * 1024];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) data.append(buffer, n);
+    std::fclose(file);
+
+    if (data.size() < 8 || std::memcmp(data.data(), kMagic, 8) != 0) return false;
+    const char* p = data.data() + 8;
+    const char* end = data.data() + data.size();
+    uint64_t wallClock = 0;
+    if (!getVarint(p, end, wallClock)) return false;
+    if (wallClockUs) *wallClockUs = wallClock;
+
+    Record record;
+    while (decode(p, end, record)) records.push_back(record); // A torn last record is dropped
+    return true;
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Server {
+
+// Opt-in recording of request metadata for replay benchmarks (tools/Replay.cpp).
+//
+// No bodies, and of the headers only those that change what the server does
+// (Range, Content-Length, Accept-Encoding, If-None-Match): one record is
+// typically 30-80 bytes. Fields are LEB128 varints and length-prefixed
+// strings after an 8-byte magic and the wall-clock start time. Records are appended to a memory buffer under a
+// mutex and written out in 64KB blocks (or once a second), so capture costs
+// a connection thread one short critical section per request.
+class TrafficCapture {
+public:
+    enum class Method : uint8_t { Get, Post, Head, Other };
+
+    struct Record {
+        uint64_t startUs = 0;       // Since the capture began
+        uint64_t connection = 0;    // Requests with the same id shared a socket
+        Method method = Method::Get;
+        std::string otherMethod;    // Method::Other: the method as sent (PUT, OPTIONS, ...)
+        std::string path;           // As requested, query included
+        std::string range;          // As sent, so suffix and multi-range requests replay exactly; empty: absent
+        uint64_t requestBytes = 0;  // Request body (uploads)
+        std::string acceptEncoding; // Empty: header absent
+        std::string ifNoneMatch;
+        uint16_t status = 0;        // 0: no response was sent
+        uint64_t responseBytes = 0; // Headers and body (before TLS)
+        uint64_t durationUs = 0;    // Headers received -> handler done
+    };
+
+    static constexpr char kMagic[9] = "LWCAP03\n";
+
+    TrafficCapture();
+    ~TrafficCapture();
+
+    // Truncates path. Returns false if it cannot be created.
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return m_open.load(std::memory_order_relaxed); }
+
+    // Capture clock, for Record::startUs
+    uint64_t nowUs() const;
+    void write(const Record& record);
+
+    static Method methodFromString(const std::string& method);
+    static std::string methodName(const Record& record);
+
+    static void encode(const Record& record, std::string& out);
+    // Advances p past one record; false at the end or on a truncated record
+    static bool decode(const char*& p, const char* end, Record& record);
+    // Reads a whole capture; false when the file is missing or not a capture
+    static bool readFile(const std::string& path, std::vector<Record>& records, uint64_t* wallClockUs = nullptr);
+
+private:
+    void flushLocked();
+
+    std::mutex m_mutex;
+    std::FILE* m_file;
+    std::string m_buffer;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_lastFlush;
+    std::atomic<bool> m_open;
+};
+
+}
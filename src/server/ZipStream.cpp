@@ -0,0 +1,501 @@
+#include "ZipStream.hpp"
+#include "DiskScheduler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <map>
+
+#ifdef LOCALWAVES_HAS_ZLIB
+    #include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Server {
+
+namespace {
+
+constexpr uint64_t kLocalHeaderFixed = 30;
+constexpr uint64_t kLocalExtra = 20;        // ZIP64: id, size, uncompressed, compressed
+constexpr uint64_t kDescriptorSize = 24;    // ZIP64 data descriptor with signature
+constexpr uint64_t kCentralFixed = 46;
+constexpr uint64_t kCentralExtra = 28;      // ZIP64: id, size, uncompressed, compressed, offset
+constexpr uint64_t kEndRecords = 56 + 20 + 22; // ZIP64 EOCD + locator + EOCD
+constexpr uint16_t kVersion = 45;           // ZIP64
+constexpr uint16_t kFlags = 0x0008 | 0x0800; // Data descriptor, UTF-8 names
+
+constexpr auto kArchiveReuse = std::chrono::seconds(30);
+
+// Archives in use, for download managers fetching many ranges. Not owning:
+// an archive (and its hashing) goes away with the last download using it.
+struct CachedArchive {
+    std::weak_ptr<const ZipArchive> archive;
+    std::chrono::steady_clock::time_point builtAt;
+};
+std::mutex g_archiveMutex;
+std::map<std::string, CachedArchive> g_archives;
+
+void put16(std::string& out, uint16_t v) {
+    out.push_back(char(v & 0xff));
+    out.push_back(char(v >> 8));
+}
+
+void put32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(char((v >> (8 * i)) & 0xff));
+}
+
+void put64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(char((v >> (8 * i)) & 0xff));
+}
+
+std::string crcKey(const fs::path& path, int64_t mtime, uint64_t size) {
+    return path.string() + "|" + std::to_string(mtime) + "|" + std::to_string(size);
+}
+
+void toDosTime(fs::file_time_type ftime, uint16_t& dosTime, uint16_t& dosDate) {
+    // C++17 has no clock_cast: shift through "now" on both clocks
+    auto sys = std::chrono::system_clock::now()
+             + std::chrono::duration_cast<std::chrono::system_clock::duration>(ftime - fs::file_time_type::clock::now());
+    std::time_t t = std::chrono::system_clock::to_time_t(sys);
+    std::tm tm = {};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    if (tm.tm_year < 80) { // DOS dates start in 1980
+        dosTime = 0;
+        dosDate = (1 << 5) | 1;
+        return;
+    }
+    dosTime = uint16_t((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+    dosDate = uint16_t(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+}
+
+ZipHasher::ZipHasher(DiskScheduler* disks) : m_disks(disks) {}
+
+ZipHasher::~ZipHasher() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_work.notify_all(); // A member being hashed stops at its next read
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void ZipHasher::enqueue(const std::string& key, const fs::path& path, uint64_t size, bool urgent,
+                        const std::weak_ptr<const void>& owner) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_crcs.count(key) || m_failed.count(key)) return;
+    auto it = m_jobs.find(key);
+    if (it == m_jobs.end()) {
+        it = m_jobs.emplace(key, Job{path, size, {}, false}).first;
+        if (!urgent) m_order.push_back(key);
+    }
+    Job& job = it->second;
+    bool owned = std::any_of(job.owners.begin(), job.owners.end(), [&owner](const std::weak_ptr<const void>& o) {
+        return !o.owner_before(owner) && !owner.owner_before(o);
+    });
+    if (!owned) job.owners.push_back(owner);
+    if (urgent && !job.active) m_order.push_front(key); // An older position is skipped later
+    if (!m_thread.joinable()) m_thread = std::thread(&ZipHasher::run, this);
+    m_work.notify_one();
+}
+
+ZipHasher::State ZipHasher::get(const std::string& key, uint32_t& crc, std::chrono::milliseconds wait) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto done = [&] { return m_crcs.count(key) || m_failed.count(key) || !m_jobs.count(key); };
+    if (wait.count() > 0) m_done.wait_for(lock, wait, done);
+    auto it = m_crcs.find(key);
+    if (it != m_crcs.end()) {
+        crc = it->second;
+        return State::Ready;
+    }
+    return m_failed.count(key) ? State::Failed : State::Pending;
+}
+
+bool ZipHasher::wanted(const std::string& key) {
+    auto it = m_jobs.find(key);
+    if (it == m_jobs.end() || m_stop) return false;
+    auto& owners = it->second.owners;
+    owners.erase(std::remove_if(owners.begin(), owners.end(), [](const std::weak_ptr<const void>& o) { return o.expired(); }),
+                 owners.end());
+    return !owners.empty();
+}
+
+void ZipHasher::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_work.wait(lock, [this] { return m_stop || !m_order.empty(); });
+        if (m_stop) return;
+        std::string key = std::move(m_order.front());
+        m_order.pop_front();
+        auto it = m_jobs.find(key);
+        if (it == m_jobs.end() || it->second.active) continue; // Stale position
+        if (!wanted(key)) {
+            m_jobs.erase(it); // Every archive that wanted it is gone
+            m_done.notify_all();
+            continue;
+        }
+        it->second.active = true;
+        fs::path path = it->second.path;
+        uint64_t size = it->second.size;
+        lock.unlock();
+
+        uint32_t crc = 0;
+        Outcome outcome = hash(key, path, size, crc);
+
+        lock.lock();
+        m_jobs.erase(key);
+        if (m_crcs.size() > 200000) m_crcs.clear(); // Crude bound; entries are cheap to redo
+        if (m_failed.size() > 10000) m_failed.clear();
+        if (outcome == Outcome::Done) m_crcs[key] = crc;
+        else if (outcome == Outcome::Failed) m_failed.insert(key);
+        m_done.notify_all();
+    }
+}
+
+ZipHasher::Outcome ZipHasher::hash(const std::string& key, const fs::path& path, uint64_t size, uint32_t& crc) {
+    // Exactly the listed size: a file that shrank since cannot be archived
+    auto keepGoing = [this, &key] {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return wanted(key);
+    };
+    crc = 0;
+    uint64_t remaining = size;
+    FILE* fp = fopen(path.string().c_str(), "rb");
+    if (!fp) return Outcome::Failed;
+    bool dropped = false;
+#ifdef __linux__
+    // Through the device queue, so hashing takes turns with streams on a spinning disk
+    if (DiskScheduler::Device* disk = m_disks ? m_disks->deviceFor(fileno(fp)) : nullptr) {
+        {
+            DiskReader reader(*m_disks, disk, fileno(fp), 0, size, true);
+            uint64_t offset;
+            size_t length;
+            const char* data;
+            while (remaining > 0 && !(dropped = !keepGoing()) && reader.next(offset, length, data)) {
+                crc = ZipArchive::crc32(crc, (const unsigned char*)data, length);
+                remaining -= length;
+            }
+        }
+        fclose(fp);
+        if (dropped) return Outcome::Dropped;
+        return remaining == 0 ? Outcome::Done : Outcome::Failed;
+    }
+#endif
+    std::vector<unsigned char> buffer(256 * 1024);
+    while (remaining > 0 && !(dropped = !keepGoing())) {
+        size_t n = fread(buffer.data(), 1, (size_t)std::min<uint64_t>(buffer.size(), remaining), fp);
+        if (n == 0) break;
+        crc = ZipArchive::crc32(crc, buffer.data(), n);
+        remaining -= n;
+    }
+    fclose(fp);
+    if (dropped) return Outcome::Dropped;
+    return remaining == 0 ? Outcome::Done : Outcome::Failed;
+}
+
+uint32_t ZipArchive::crc32(uint32_t crc, const unsigned char* data, size_t length) {
+#ifdef LOCALWAVES_HAS_ZLIB
+    while (length > 0) {
+        uInt chunk = (uInt)std::min<size_t>(length, 1u << 30);
+        crc = (uint32_t)::crc32(crc, data, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+    return crc;
+#else
+    static const auto table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+#endif
+}
+
+std::shared_ptr<const ZipArchive> ZipArchive::open(const fs::path& dir, ZipHasher& hasher, std::string& error) {
+    const std::string key = dir.string();
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(g_archiveMutex);
+        auto it = g_archives.find(key);
+        if (it != g_archives.end() && now - it->second.builtAt < kArchiveReuse) {
+            auto archive = it->second.archive.lock();
+            if (archive && archive->m_hasher == &hasher) return archive;
+        }
+    }
+
+    auto archive = std::make_shared<ZipArchive>();
+    archive->m_root = dir;
+    archive->m_hasher = &hasher;
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        error = ec.message();
+        return nullptr;
+    }
+    for (; it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) break;
+        const std::string filename = it->path().filename().string();
+        if (!filename.empty() && filename[0] == '.') { // Same rule as the listing
+            if (it->is_directory(ec)) it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_regular_file(ec)) continue;
+
+        Entry entry;
+        entry.source = it->path();
+        entry.name = fs::relative(it->path(), dir, ec).generic_u8string();
+        entry.size = it->file_size(ec);
+        if (ec) continue;
+        auto ftime = it->last_write_time(ec);
+        entry.mtime = (int64_t)ftime.time_since_epoch().count();
+        toDosTime(ftime, entry.dosTime, entry.dosDate);
+        archive->m_entries.push_back(std::move(entry));
+    }
+
+    std::sort(archive->m_entries.begin(), archive->m_entries.end(),
+              [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    archive->layout();
+    // Checksums are needed after each member and in the central directory:
+    // start on them now, ahead of the download
+    for (const Entry& entry : archive->m_entries) {
+        if (entry.size > 0) hasher.enqueue(crcKey(entry.source, entry.mtime, entry.size), entry.source, entry.size, false, archive);
+    }
+
+    std::lock_guard<std::mutex> lock(g_archiveMutex);
+    for (auto cached = g_archives.begin(); cached != g_archives.end();) {
+        if (now - cached->second.builtAt >= kArchiveReuse || cached->second.archive.expired()) cached = g_archives.erase(cached);
+        else ++cached;
+    }
+    g_archives[key] = CachedArchive{archive, now};
+    return archive;
+}
+
+void ZipArchive::layout() {
+    uint64_t offset = 0;
+    uint64_t hash = 1469598103934665603ull; // FNV-1a over the member list
+    auto mix = [&hash](const std::string& s) {
+        for (unsigned char c : s) { hash ^= c; hash *= 1099511628211ull; }
+    };
+
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        Entry& entry = m_entries[i];
+        uint64_t headerLength = kLocalHeaderFixed + entry.name.size() + kLocalExtra;
+        entry.headerOffset = offset;
+        entry.dataOffset = offset + headerLength;
+
+        m_segments.push_back(Segment{SegmentType::LocalHeader, i, offset, headerLength});
+        m_segments.push_back(Segment{SegmentType::Data, i, entry.dataOffset, entry.size});
+        m_segments.push_back(Segment{SegmentType::Descriptor, i, entry.dataOffset + entry.size, kDescriptorSize});
+        offset = entry.dataOffset + entry.size + kDescriptorSize;
+
+        mix(entry.name);
+        mix(std::to_string(entry.size) + ":" + std::to_string(entry.mtime));
+    }
+
+    m_centralDirOffset = offset;
+    m_centralDirSize = 0;
+    for (const Entry& entry : m_entries) m_centralDirSize += kCentralFixed + entry.name.size() + kCentralExtra;
+    m_segments.push_back(Segment{SegmentType::CentralDirectory, 0, offset, m_centralDirSize + kEndRecords});
+    m_totalSize = offset + m_centralDirSize + kEndRecords;
+
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "\"zip-%016llx\"", (unsigned long long)hash);
+    m_etag = buf;
+}
+
+std::string ZipArchive::localHeader(const Entry& entry) const {
+    std::string out;
+    out.reserve(kLocalHeaderFixed + entry.name.size() + kLocalExtra);
+    put32(out, 0x04034b50);
+    put16(out, kVersion);
+    put16(out, kFlags);
+    put16(out, 0);               // Stored
+    put16(out, entry.dosTime);
+    put16(out, entry.dosDate);
+    put32(out, 0);               // CRC follows in the data descriptor
+    put32(out, 0xFFFFFFFF);      // Sizes live in the ZIP64 extra field
+    put32(out, 0xFFFFFFFF);
+    put16(out, (uint16_t)entry.name.size());
+    put16(out, (uint16_t)kLocalExtra);
+    out += entry.name;
+    put16(out, 0x0001);
+    put16(out, 16);
+    put64(out, entry.size);
+    put64(out, entry.size);
+    return out;
+}
+
+std::string ZipArchive::descriptor(const Entry& entry, uint32_t crc) const {
+    std::string out;
+    out.reserve(kDescriptorSize);
+    put32(out, 0x08074b50);
+    put32(out, crc);
+    put64(out, entry.size);
+    put64(out, entry.size);
+    return out;
+}
+
+std::string ZipArchive::centralDirectory(const std::vector<uint32_t>& crcs) const {
+    std::string out;
+    out.reserve(m_centralDirSize + kEndRecords);
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        const Entry& entry = m_entries[i];
+        put32(out, 0x02014b50);
+        put16(out, (3 << 8) | kVersion); // Made by: Unix, so external attrs carry mode bits
+        put16(out, kVersion);
+        put16(out, kFlags);
+        put16(out, 0);
+        put16(out, entry.dosTime);
+        put16(out, entry.dosDate);
+        put32(out, crcs[i]);
+        put32(out, 0xFFFFFFFF);
+        put32(out, 0xFFFFFFFF);
+        put16(out, (uint16_t)entry.name.size());
+        put16(out, (uint16_t)kCentralExtra);
+        put16(out, 0);               // Comment
+        put16(out, 0);               // Disk
+        put16(out, 0);               // Internal attributes
+        put32(out, 0100644u << 16);  // -rw-r--r--
+        put32(out, 0xFFFFFFFF);      // Offset in the ZIP64 extra field
+        out += entry.name;
+        put16(out, 0x0001);
+        put16(out, 24);
+        put64(out, entry.size);
+        put64(out, entry.size);
+        put64(out, entry.headerOffset);
+    }
+
+    const uint64_t zip64EndOffset = m_centralDirOffset + m_centralDirSize;
+    put32(out, 0x06064b50);          // ZIP64 end of central directory record
+    put64(out, 44);
+    put16(out, (3 << 8) | kVersion);
+    put16(out, kVersion);
+    put32(out, 0);
+    put32(out, 0);
+    put64(out, m_entries.size());
+    put64(out, m_entries.size());
+    put64(out, m_centralDirSize);
+    put64(out, m_centralDirOffset);
+
+    put32(out, 0x07064b50);          // ZIP64 end of central directory locator
+    put32(out, 0);
+    put64(out, zip64EndOffset);
+    put32(out, 1);
+
+    put32(out, 0x06054b50);          // End of central directory (all values in ZIP64)
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, 0xFFFF);
+    put16(out, 0xFFFF);
+    put32(out, 0xFFFFFFFF);
+    put32(out, 0xFFFFFFFF);
+    put16(out, 0);
+    return out;
+}
+
+bool ZipArchive::lookupCrc(const Entry& entry, bool urgent, uint32_t& crc) const {
+    crc = 0;
+    if (entry.size == 0) return true;
+    const std::string key = crcKey(entry.source, entry.mtime, entry.size);
+    if (m_hasher->get(key, crc, std::chrono::milliseconds(0)) == ZipHasher::State::Ready) return true;
+    m_hasher->enqueue(key, entry.source, entry.size, urgent, weak_from_this());
+    return false;
+}
+
+bool ZipArchive::waitCrc(const Entry& entry, const Sink& sink, uint32_t& crc) const {
+    if (lookupCrc(entry, true, crc)) return true;
+    const std::string key = crcKey(entry.source, entry.mtime, entry.size);
+    while (true) {
+        switch (m_hasher->get(key, crc, std::chrono::milliseconds(1000))) {
+            case ZipHasher::State::Ready: return true;
+            case ZipHasher::State::Failed: return false; // Unreadable or truncated since the listing
+            case ZipHasher::State::Pending: break;
+        }
+        if (sink.keepAlive && !sink.keepAlive()) return false;
+        m_hasher->enqueue(key, entry.source, entry.size, true, weak_from_this()); // Requeues if the cache was trimmed
+    }
+}
+
+void ZipArchive::prioritize(uint64_t start, uint64_t length) const {
+    // Needed in stream order: each descriptor in the range, then (for the
+    // central directory) every other member
+    const uint64_t end = start + length;
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), start,
+                               [](uint64_t pos, const Segment& seg) { return pos < seg.offset + seg.length; });
+    std::vector<size_t> needed;
+    std::vector<bool> listed(m_entries.size(), false);
+    for (; it != m_segments.end() && it->offset < end; ++it) {
+        if (it->type == SegmentType::Descriptor) {
+            needed.push_back(it->entry);
+            listed[it->entry] = true;
+        } else if (it->type == SegmentType::CentralDirectory) {
+            for (size_t i = 0; i < m_entries.size(); ++i) {
+                if (!listed[i]) needed.push_back(i);
+            }
+        }
+    }
+    // Each urgent member goes to the front, so queue the last one first
+    uint32_t crc;
+    for (auto entry = needed.rbegin(); entry != needed.rend(); ++entry) lookupCrc(m_entries[*entry], true, crc);
+}
+
+bool ZipArchive::stream(uint64_t start, uint64_t length, const Sink& sink) const {
+    const uint64_t end = start + length;
+    // First segment that ends after start
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), start,
+                               [](uint64_t pos, const Segment& seg) { return pos < seg.offset + seg.length; });
+
+    for (; it != m_segments.end() && it->offset < end; ++it) {
+        const Segment& seg = *it;
+        if (seg.length == 0) continue;
+        uint64_t from = std::max(start, seg.offset) - seg.offset;
+        uint64_t to = std::min(end, seg.offset + seg.length) - seg.offset;
+
+        bool ok = true;
+        switch (seg.type) {
+            case SegmentType::LocalHeader: {
+                std::string bytes = localHeader(m_entries[seg.entry]);
+                ok = sink.writeBytes(bytes.data() + from, to - from);
+                break;
+            }
+            case SegmentType::Data:
+                ok = to == from || sink.writeFile(m_entries[seg.entry].source, from, to - from);
+                break;
+            case SegmentType::Descriptor: {
+                // Usually hashed by now: the hasher reads ahead while members go out
+                const Entry& entry = m_entries[seg.entry];
+                uint32_t crc;
+                if (!waitCrc(entry, sink, crc)) return false;
+                std::string bytes = descriptor(entry, crc);
+                ok = sink.writeBytes(bytes.data() + from, to - from);
+                break;
+            }
+            case SegmentType::CentralDirectory: {
+                std::vector<uint32_t> crcs(m_entries.size());
+                for (size_t i = 0; i < m_entries.size(); ++i) {
+                    if (!waitCrc(m_entries[i], sink, crcs[i])) return false;
+                }
+                std::string bytes = centralDirectory(crcs);
+                ok = sink.writeBytes(bytes.data() + from, to - from);
+                break;
+            }
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+}
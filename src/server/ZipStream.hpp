@@ -0,0 +1,148 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <filesystem>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Server {
+
+class DiskScheduler;
+
+// Background CRC-32 of archive members, so requests never read a member
+// through user space just to checksum it. One thread works through the
+// queued members in order, reading through the DiskScheduler like any
+// stream. A member a request is waiting for moves to the front. Each job
+// belongs to the archives that queued it: once all of them are gone (the
+// last download ended) the job is dropped, even mid-member. Results are
+// cached by path/mtime/size, so a re-opened archive reuses them.
+class ZipHasher {
+public:
+    enum class State { Ready, Pending, Failed };
+
+    explicit ZipHasher(DiskScheduler* disks = nullptr);
+    ~ZipHasher();
+
+    // Queues the member for owner unless its CRC is known; a queued one gains the owner
+    void enqueue(const std::string& key, const std::filesystem::path& path, uint64_t size, bool urgent,
+                 const std::weak_ptr<const void>& owner);
+    // Waits up to `wait` for the CRC. Pending also when the job was dropped.
+    State get(const std::string& key, uint32_t& crc, std::chrono::milliseconds wait);
+
+private:
+    struct Job {
+        std::filesystem::path path;
+        uint64_t size = 0;
+        std::vector<std::weak_ptr<const void>> owners;
+        bool active = false;
+    };
+    enum class Outcome { Done, Failed, Dropped };
+
+    void run();
+    Outcome hash(const std::string& key, const std::filesystem::path& path, uint64_t size, uint32_t& crc);
+    bool wanted(const std::string& key); // With m_mutex held
+
+    DiskScheduler* m_disks;
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_done;
+    std::unordered_map<std::string, Job> m_jobs; // Queued or being hashed
+    std::deque<std::string> m_order;             // May hold stale keys; skipped when popped
+    std::unordered_map<std::string, uint32_t> m_crcs; // path|mtime|size -> CRC-32
+    std::unordered_set<std::string> m_failed;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+};
+
+// Store-mode (no compression) ZIP64 archive of a folder, generated on the fly.
+//
+// Every header has a fixed size, so the archive's total size and the offset
+// of each member are known before a byte is sent. That gives exact
+// Content-Length and Range support, and member data always goes out through
+// the zero-copy file path. CRC-32 is only needed in the data descriptor after
+// each member and in the central directory. The ZipHasher starts on the
+// members when the archive is opened, and a download waits for a member's
+// CRC only if it gets ahead of the hasher. A range further in first moves
+// the members it needs to the front (prioritize()). The trade-off: a range
+// that includes the central directory needs every CRC, so on a large folder
+// its last bytes can wait until the whole tree is hashed.
+class ZipArchive : public std::enable_shared_from_this<ZipArchive> {
+public:
+    // Receives archive bytes: header/trailer bytes from memory, or a range of a file
+    struct Sink {
+        std::function<bool(const char* data, size_t length)> writeBytes;
+        std::function<bool(const std::filesystem::path& path, uint64_t offset, uint64_t length)> writeFile;
+        // Called about once a second while waiting for a CRC; false aborts
+        std::function<bool()> keepAlive;
+    };
+
+    // Walks dir recursively (hidden entries skipped). An archive of the same
+    // folder still in use is reused, so segmented downloads do not re-walk it.
+    static std::shared_ptr<const ZipArchive> open(const std::filesystem::path& dir, ZipHasher& hasher, std::string& error);
+
+    uint64_t totalSize() const { return m_totalSize; }
+    size_t entryCount() const { return m_entries.size(); }
+    // Changes whenever a member is added, removed, resized or touched
+    const std::string& etag() const { return m_etag; }
+
+    // Moves the members whose CRCs the range needs to the front of the
+    // hashing queue, in the order the range needs them
+    void prioritize(uint64_t start, uint64_t length) const;
+
+    // Emits archive bytes [start, start + length) into sink
+    bool stream(uint64_t start, uint64_t length, const Sink& sink) const;
+
+    // Standard CRC-32 (ISO-HDLC) as used by ZIP, continuing from crc
+    static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t length);
+
+private:
+    struct Entry {
+        std::string name;              // UTF-8, '/' separated, relative to the root
+        std::filesystem::path source;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint16_t dosTime = 0;
+        uint16_t dosDate = 0;
+        uint64_t headerOffset = 0;     // Local file header
+        uint64_t dataOffset = 0;       // First byte of the member data
+    };
+
+    enum class SegmentType { LocalHeader, Data, Descriptor, CentralDirectory };
+    struct Segment {
+        SegmentType type;
+        size_t entry;                  // Unused for CentralDirectory
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    void layout();
+    std::string localHeader(const Entry& entry) const;
+    std::string descriptor(const Entry& entry, uint32_t crc) const;
+    std::string centralDirectory(const std::vector<uint32_t>& crcs) const;
+
+    // Cached CRC, or false after queueing the member for hashing
+    bool lookupCrc(const Entry& entry, bool urgent, uint32_t& crc) const;
+    // Blocks until the member is hashed; false if it cannot be or keepAlive said stop
+    bool waitCrc(const Entry& entry, const Sink& sink, uint32_t& crc) const;
+
+    std::filesystem::path m_root;
+    ZipHasher* m_hasher = nullptr;
+    std::vector<Entry> m_entries;
+    std::vector<Segment> m_segments;
+    uint64_t m_centralDirOffset = 0;
+    uint64_t m_centralDirSize = 0;
+    uint64_t m_totalSize = 0;
+    std::string m_etag;
+};
+
+}
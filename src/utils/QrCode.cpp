@@ -0,0 +1,360 @@
+#include "QrCode.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+namespace Utils {
+
+namespace {
+
+// Error-correction codewords per block and number of blocks, by [ecc][version]
+const int8_t kEccPerBlock[4][41] = {
+    {-1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {-1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},
+    {-1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {-1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+};
+const int8_t kBlocks[4][41] = {
+    {-1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4, 4, 4, 4, 4, 6, 6, 6, 6, 7, 8, 8, 9, 9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},
+    {-1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5, 5, 8, 9, 9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},
+    {-1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8, 8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},
+    {-1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},
+};
+
+// GF(256) with the QR polynomial x^8 + x^4 + x^3 + x^2 + 1
+struct Galois {
+    uint8_t exp[512];
+    uint8_t log[256];
+    Galois() {
+        int x = 1;
+        for (int i = 0; i < 255; ++i) {
+            exp[i] = (uint8_t)x;
+            log[x] = (uint8_t)i;
+            x <<= 1;
+            if (x & 0x100) x ^= 0x11D;
+        }
+        for (int i = 255; i < 512; ++i) exp[i] = exp[i - 255];
+        log[0] = 0;
+    }
+    uint8_t mul(uint8_t a, uint8_t b) const {
+        return (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+    }
+};
+
+const Galois& galois() {
+    static const Galois table;
+    return table;
+}
+
+class BitBuffer {
+public:
+    void append(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; --i) m_bits.push_back((value >> i) & 1);
+    }
+    size_t size() const { return m_bits.size(); }
+    std::vector<uint8_t> bytes() const {
+        std::vector<uint8_t> out(m_bits.size() / 8, 0);
+        for (size_t i = 0; i < out.size() * 8; ++i) {
+            if (m_bits[i]) out[i / 8] |= (uint8_t)(0x80 >> (i % 8));
+        }
+        return out;
+    }
+
+private:
+    std::vector<bool> m_bits;
+};
+
+int countBits(int version) {
+    return version <= 9 ? 8 : 16; // Byte mode character count indicator
+}
+
+}
+
+QrCode::QrCode(int version, Ecc ecc)
+    : m_version(version), m_size(version > 0 ? version * 4 + 17 : 0), m_ecc(ecc), m_mask(-1),
+      m_modules(m_size * m_size, 0), m_function(m_size * m_size, 0) {}
+
+int QrCode::rawDataModules(int version) {
+    int result = (16 * version + 128) * version + 64;
+    if (version >= 2) {
+        int align = version / 7 + 2;
+        result -= (25 * align - 10) * align - 55;
+        if (version >= 7) result -= 36;
+    }
+    return result;
+}
+
+int QrCode::dataCapacity(int version, Ecc ecc) {
+    int e = (int)ecc;
+    return rawDataModules(version) / 8 - kEccPerBlock[e][version] * kBlocks[e][version];
+}
+
+std::vector<int> QrCode::alignmentPositions(int version) {
+    if (version == 1) return {};
+    int count = version / 7 + 2;
+    int step = version == 32 ? 26 : (version * 4 + count * 2 + 1) / (count * 2 - 2) * 2;
+    std::vector<int> result(count);
+    result[0] = 6;
+    for (int i = count - 1, pos = version * 4 + 17 - 7; i >= 1; --i, pos -= step) result[i] = pos;
+    return result;
+}
+
+std::vector<uint8_t> QrCode::dataCodewords(const std::string& text, int version, Ecc ecc) {
+    const size_t capacityBits = (size_t)dataCapacity(version, ecc) * 8;
+    BitBuffer bits;
+    bits.append(0x4, 4); // Byte mode
+    bits.append((uint32_t)text.size(), countBits(version));
+    for (unsigned char c : text) bits.append(c, 8);
+
+    bits.append(0, (int)std::min<size_t>(4, capacityBits - bits.size())); // Terminator
+    bits.append(0, (int)((8 - bits.size() % 8) % 8));
+    for (uint8_t pad = 0xEC; bits.size() < capacityBits; pad ^= 0xEC ^ 0x11) bits.append(pad, 8);
+    return bits.bytes();
+}
+
+std::vector<uint8_t> QrCode::reedSolomon(const std::vector<uint8_t>& data, int eccLength) {
+    const Galois& gf = galois();
+    // Generator (x - a^0)(x - a^1)...(x - a^(n-1)), highest degree first
+    std::vector<uint8_t> generator(eccLength + 1, 0);
+    generator[0] = 1;
+    for (int i = 0; i < eccLength; ++i) {
+        for (int j = i + 1; j >= 1; --j) generator[j] ^= gf.mul(generator[j - 1], gf.exp[i]);
+    }
+
+    std::vector<uint8_t> remainder(eccLength, 0);
+    for (uint8_t byte : data) {
+        uint8_t factor = byte ^ remainder[0];
+        std::rotate(remainder.begin(), remainder.begin() + 1, remainder.end());
+        remainder.back() = 0;
+        for (int k = 0; k < eccLength; ++k) remainder[k] ^= gf.mul(generator[k + 1], factor);
+    }
+    return remainder;
+}
+
+uint16_t QrCode::formatBits(Ecc ecc, int mask) {
+    static const int eccBits[] = {1, 0, 3, 2}; // L, M, Q, H as coded in the symbol
+    int data = eccBits[(int)ecc] << 3 | mask;
+    int rem = data;
+    for (int i = 0; i < 10; ++i) rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+    return (uint16_t)((data << 10 | rem) ^ 0x5412);
+}
+
+uint32_t QrCode::versionBits(int version) {
+    int rem = version;
+    for (int i = 0; i < 12; ++i) rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
+    return (uint32_t)version << 12 | (uint32_t)rem;
+}
+
+std::vector<uint8_t> QrCode::interleave(const std::vector<uint8_t>& data, int version, Ecc ecc) {
+    const int blocks = kBlocks[(int)ecc][version];
+    const int eccLength = kEccPerBlock[(int)ecc][version];
+    const int rawCodewords = rawDataModules(version) / 8;
+    const int shortBlocks = blocks - rawCodewords % blocks;
+    const int shortDataLength = rawCodewords / blocks - eccLength;
+
+    std::vector<std::vector<uint8_t>> dataBlocks, eccBlocks;
+    size_t offset = 0;
+    for (int i = 0; i < blocks; ++i) {
+        int length = shortDataLength + (i < shortBlocks ? 0 : 1);
+        dataBlocks.emplace_back(data.begin() + offset, data.begin() + offset + length);
+        eccBlocks.push_back(reedSolomon(dataBlocks.back(), eccLength));
+        offset += length;
+    }
+
+    std::vector<uint8_t> result;
+    result.reserve(rawCodewords);
+    for (int i = 0; i <= shortDataLength; ++i) {
+        for (int j = 0; j < blocks; ++j) {
+            if (i < (int)dataBlocks[j].size()) result.push_back(dataBlocks[j][i]);
+        }
+    }
+    for (int i = 0; i < eccLength; ++i) {
+        for (int j = 0; j < blocks; ++j) result.push_back(eccBlocks[j][i]);
+    }
+    return result;
+}
+
+void QrCode::setFunction(int x, int y, bool dark) {
+    m_modules[y * m_size + x] = dark;
+    m_function[y * m_size + x] = 1;
+}
+
+void QrCode::drawFinder(int cx, int cy) {
+    // 7x7 finder plus the light separator around it
+    for (int dy = -4; dy <= 4; ++dy) {
+        for (int dx = -4; dx <= 4; ++dx) {
+            int x = cx + dx, y = cy + dy;
+            if (x < 0 || x >= m_size || y < 0 || y >= m_size) continue;
+            int distance = std::max(std::abs(dx), std::abs(dy));
+            setFunction(x, y, distance != 2 && distance != 4);
+        }
+    }
+}
+
+void QrCode::drawAlignment(int cx, int cy) {
+    for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) setFunction(cx + dx, cy + dy, std::max(std::abs(dx), std::abs(dy)) != 1);
+    }
+}
+
+void QrCode::drawFormat(int mask) {
+    uint16_t bits = formatBits(m_ecc, mask);
+    auto bit = [bits](int i) { return ((bits >> i) & 1) != 0; };
+
+    // Copy around the top-left finder
+    for (int i = 0; i <= 5; ++i) setFunction(8, i, bit(i));
+    setFunction(8, 7, bit(6));
+    setFunction(8, 8, bit(7));
+    setFunction(7, 8, bit(8));
+    for (int i = 9; i < 15; ++i) setFunction(14 - i, 8, bit(i));
+
+    // Copy split between the other two finders
+    for (int i = 0; i < 8; ++i) setFunction(m_size - 1 - i, 8, bit(i));
+    for (int i = 8; i < 15; ++i) setFunction(8, m_size - 15 + i, bit(i));
+    setFunction(8, m_size - 8, true); // Dark module
+}
+
+void QrCode::drawFunctionPatterns() {
+    for (int i = 0; i < m_size; ++i) {
+        setFunction(6, i, i % 2 == 0);
+        setFunction(i, 6, i % 2 == 0);
+    }
+
+    drawFinder(3, 3);
+    drawFinder(m_size - 4, 3);
+    drawFinder(3, m_size - 4);
+
+    std::vector<int> positions = alignmentPositions(m_version);
+    int count = (int)positions.size();
+    for (int i = 0; i < count; ++i) {
+        for (int j = 0; j < count; ++j) {
+            // Skip the three corners taken by finders
+            if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0)) continue;
+            drawAlignment(positions[i], positions[j]);
+        }
+    }
+
+    drawFormat(0); // Reserves the area; redrawn once the mask is chosen
+
+    if (m_version >= 7) {
+        uint32_t bits = versionBits(m_version);
+        for (int i = 0; i < 18; ++i) {
+            bool dark = ((bits >> i) & 1) != 0;
+            int a = m_size - 11 + i % 3;
+            int b = i / 3;
+            setFunction(a, b, dark);
+            setFunction(b, a, dark);
+        }
+    }
+}
+
+void QrCode::placeCodewords(const std::vector<uint8_t>& codewords) {
+    size_t i = 0;
+    const size_t totalBits = codewords.size() * 8;
+    // Two-module columns, right to left, alternating upward and downward
+    for (int right = m_size - 1; right >= 1; right -= 2) {
+        if (right == 6) right = 5; // Vertical timing pattern
+        bool upward = ((right + 1) & 2) == 0;
+        for (int vertical = 0; vertical < m_size; ++vertical) {
+            int y = upward ? m_size - 1 - vertical : vertical;
+            for (int j = 0; j < 2; ++j) {
+                int x = right - j;
+                if (m_function[y * m_size + x] || i >= totalBits) continue;
+                m_modules[y * m_size + x] = ((codewords[i >> 3] >> (7 - (i & 7))) & 1) != 0;
+                ++i;
+            }
+        }
+    }
+}
+
+void QrCode::applyMask(int mask) {
+    for (int y = 0; y < m_size; ++y) {
+        for (int x = 0; x < m_size; ++x) {
+            bool invert = false;
+            switch (mask) {
+                case 0: invert = (x + y) % 2 == 0; break;
+                case 1: invert = y % 2 == 0; break;
+                case 2: invert = x % 3 == 0; break;
+                case 3: invert = (x + y) % 3 == 0; break;
+                case 4: invert = (x / 3 + y / 2) % 2 == 0; break;
+                case 5: invert = x * y % 2 + x * y % 3 == 0; break;
+                case 6: invert = (x * y % 2 + x * y % 3) % 2 == 0; break;
+                case 7: invert = ((x + y) % 2 + x * y % 3) % 2 == 0; break;
+            }
+            if (invert && !m_function[y * m_size + x]) m_modules[y * m_size + x] ^= 1;
+        }
+    }
+}
+
+int QrCode::penalty() const {
+    int score = 0;
+    auto at = [this](int x, int y) { return m_modules[y * m_size + x]; };
+
+    for (int pass = 0; pass < 2; ++pass) { // Rows, then columns
+        for (int a = 0; a < m_size; ++a) {
+            int run = 0;
+            uint8_t previous = 2;
+            uint32_t window = 0; // Last 11 modules, newest in bit 0
+            for (int b = 0; b < m_size; ++b) {
+                uint8_t c = pass ? at(a, b) : at(b, a);
+                if (c == previous) {
+                    ++run;
+                } else {
+                    if (run >= 5) score += 3 + (run - 5);
+                    run = 1;
+                    previous = c;
+                }
+                // Finder-like 1:1:3:1:1 with four light modules on one side
+                window = ((window << 1) | c) & 0x7FF;
+                if (b >= 10 && (window == 0x5D0 || window == 0x05D)) score += 40;
+            }
+            if (run >= 5) score += 3 + (run - 5);
+        }
+    }
+
+    for (int y = 0; y + 1 < m_size; ++y) {
+        for (int x = 0; x + 1 < m_size; ++x) {
+            uint8_t c = at(x, y);
+            if (c == at(x + 1, y) && c == at(x, y + 1) && c == at(x + 1, y + 1)) score += 3;
+        }
+    }
+
+    int dark = (int)std::count(m_modules.begin(), m_modules.end(), 1);
+    int total = m_size * m_size;
+    int k = (std::abs(dark * 20 - total * 10) + total - 1) / total - 1; // Steps of 5% away from 50%
+    score += std::max(0, k) * 10;
+    return score;
+}
+
+QrCode QrCode::encode(const std::string& text, Ecc ecc, int mask) {
+    int version = 1;
+    for (; version <= 40; ++version) {
+        size_t needed = 4 + countBits(version) + text.size() * 8;
+        if (needed <= (size_t)dataCapacity(version, ecc) * 8) break;
+    }
+    if (version > 40) return QrCode(0, ecc);
+
+    QrCode code(version, ecc);
+    code.drawFunctionPatterns();
+    code.placeCodewords(interleave(dataCodewords(text, version, ecc), version, ecc));
+
+    if (mask < 0 || mask > 7) {
+        int best = INT_MAX;
+        for (int candidate = 0; candidate < 8; ++candidate) {
+            code.applyMask(candidate);
+            code.drawFormat(candidate);
+            int score = code.penalty();
+            if (score < best) {
+                best = score;
+                mask = candidate;
+            }
+            code.applyMask(candidate); // XOR again to undo
+        }
+    }
+    code.applyMask(mask);
+    code.drawFormat(mask);
+    code.m_mask = mask;
+    return code;
+}
+
+}
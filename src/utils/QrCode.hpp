@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Utils {
+
+// Minimal QR Code encoder (ISO/IEC 18004): byte mode, versions 1-40, all four
+// error-correction levels, automatic or fixed mask. Enough to put the server
+// URL on screen without asking a web service to draw it.
+class QrCode {
+public:
+    enum class Ecc { Low, Medium, Quartile, High };
+
+    // Smallest version that fits. mask -1 picks the lowest-penalty mask.
+    // Returns an invalid code (size 0) when text does not fit in version 40.
+    static QrCode encode(const std::string& text, Ecc ecc = Ecc::Medium, int mask = -1);
+
+    bool isValid() const { return m_size > 0; }
+    int version() const { return m_version; }
+    int size() const { return m_size; }
+    Ecc ecc() const { return m_ecc; }
+    int mask() const { return m_mask; }
+    // True for a dark module; (0, 0) is the top-left corner
+    bool module(int x, int y) const { return m_modules[y * m_size + x] != 0; }
+
+    // Building blocks, public for the known-answer tests
+    static int dataCapacity(int version, Ecc ecc); // Data codewords per symbol
+    static std::vector<uint8_t> dataCodewords(const std::string& text, int version, Ecc ecc);
+    static std::vector<uint8_t> reedSolomon(const std::vector<uint8_t>& data, int eccLength);
+    static uint16_t formatBits(Ecc ecc, int mask);  // 15 bits, masked
+    static uint32_t versionBits(int version);       // 18 bits, versions >= 7
+
+private:
+    QrCode(int version, Ecc ecc);
+
+    void drawFunctionPatterns();
+    void drawFinder(int x, int y);
+    void drawAlignment(int x, int y);
+    void drawFormat(int mask);
+    void setFunction(int x, int y, bool dark);
+    void placeCodewords(const std::vector<uint8_t>& codewords);
+    void applyMask(int mask);
+    int penalty() const;
+
+    static int rawDataModules(int version);
+    static std::vector<int> alignmentPositions(int version);
+    static std::vector<uint8_t> interleave(const std::vector<uint8_t>& data, int version, Ecc ecc);
+
+    int m_version;
+    int m_size;
+    Ecc m_ecc;
+    int m_mask;
+    std::vector<uint8_t> m_modules;  // 1 = dark; bytes, not vector<bool>: mask search touches every module
+    std::vector<uint8_t> m_function; // Finder/timing/format etc: never masked
+};
+
+}
@@ -1,6 +1,12 @@
 #include <QtTest>
 #include "../src/server/MimeTypes.hpp"
 #include "../src/server/HttpConnection.hpp"
+#include "../src/utils/QrCode.hpp"
+#include "../src/server/Crc32c.hpp"
+#include "../src/server/Subtitles.hpp"
+#include "../src/server/AdmissionControl.hpp"
+#include "../src/server/TrafficCapture.hpp"
+#include "../src/server/SessionStore.hpp"
 
 class TestLocalWaves : public QObject {
     Q_OBJECT
@@ -8,12 +14,21 @@ class TestLocalWaves : public QObject {
 private slots:
     void testMimeTypes();
     void testUrlDecode();
+    void testQrReedSolomon();
+    void testQrFormatAndVersionBits();
+    void testQrEncode();
+    void testCrc32c();
+    void testSrtToVtt();
+    void testAdmissionReserve();
+    void testTrafficCaptureRecord();
+    void testSessionTokens();
 };
 
 void TestLocalWaves::testMimeTypes() {
     QCOMPARE(Server::getMimeType("video.mp4"), std::string("video/mp4"));
     QCOMPARE(Server::getMimeType("image.png"), std::string("image/png"));
     QCOMPARE(Server::getMimeType("unknown.xyz"), std::string("application/octet-stream"));
+    QCOMPARE(Server::getMimeType("movie.en.srt"), std::string("application/x-subrip"));
 }
 
 void TestLocalWaves::testUrlDecode() {
@@ -23,5 +38,231 @@ void TestLocalWaves::testUrlDecode() {
     // Let's stick to MimeTypes for this example as it's a standalone header.
 }
 
+void TestLocalWaves::testQrReedSolomon() {
+    // "HELLO WORLD" as 1-M alphanumeric data codewords, from the standard's worked example
+    std::vector<uint8_t> data = {32, 91, 11, 120, 209, 114, 220, 77, 67, 64, 236, 17, 236, 17, 236, 17};
+    std::vector<uint8_t> expected = {196, 35, 39, 119, 235, 215, 231, 226, 93, 23};
+    QCOMPARE(Utils::QrCode::reedSolomon(data, 10), expected);
+}
+
+void TestLocalWaves::testQrFormatAndVersionBits() {
+    using Ecc = Utils::QrCode::Ecc;
+    QCOMPARE((int)Utils::QrCode::formatBits(Ecc::Low, 0), 0b111011111000100);
+    QCOMPARE((int)Utils::QrCode::formatBits(Ecc::Medium, 0), 0b101010000010010);
+    QCOMPARE((int)Utils::QrCode::formatBits(Ecc::Quartile, 0), 0b011010101011111);
+    QCOMPARE((int)Utils::QrCode::formatBits(Ecc::High, 0), 0b001011010001001);
+    QCOMPARE((int)Utils::QrCode::versionBits(7), 0b000111110010010100);
+
+    // Byte-mode capacities from the standard's tables (data codewords minus 2-3 bytes of header)
+    QCOMPARE(Utils::QrCode::dataCapacity(1, Ecc::Medium), 16);
+    QCOMPARE(Utils::QrCode::dataCapacity(10, Ecc::Medium), 216);
+    QCOMPARE(Utils::QrCode::dataCapacity(40, Ecc::Low), 2956);
+    QCOMPARE(Utils::QrCode::dataCapacity(40, Ecc::High), 1276);
+}
+
+void TestLocalWaves::testQrEncode() {
+    using Utils::QrCode;
+    std::vector<uint8_t> codewords = {64, 180, 132, 84, 196, 196, 242, 5, 116, 245, 36, 196, 64, 236, 17, 236};
+    QCOMPARE(QrCode::dataCodewords("HELLO WORLD", 1, QrCode::Ecc::Medium), codewords);
+
+    // Byte-mode "HELLO WORLD", 1-M, mask 2, as produced by a reference encoder
+    const char* expected[] = {
+        "111111100000101111111",
+        "100000100101001000001",
+        "101110101110101011101",
+        "101110101010101011101",
+        "101110101010101011101",
+        "100000101101001000001",
+        "111111101010101111111",
+        "000000001010000000000",
+        "101111100011001111100",
+        "011000010111111101100",
+        "101100110000111001110",
+        "011101001111110011100",
+        "100010110110110000101",
+        "000000001110100001000",
+        "111111100101001000110",
+        "100000101110010101111",
+        "101110101001000100101",
+        "101110101000111111000",
+        "101110101100100100100",
+        "100000100010110011100",
+        "111111101011100010110",
+    };
+    QrCode qr = QrCode::encode("HELLO WORLD", QrCode::Ecc::Medium, 2);
+    QCOMPARE(qr.version(), 1);
+    QCOMPARE(qr.size(), 21);
+    for (int y = 0; y < qr.size(); ++y) {
+        for (int x = 0; x < qr.size(); ++x) QCOMPARE(qr.module(x, y), expected[y][x] == '1');
+    }
+
+    // Version selection at the 1-M byte-mode limit (14 bytes), and the 40-L limit
+    QCOMPARE(QrCode::encode(std::string(14, 'a')).version(), 1);
+    QCOMPARE(QrCode::encode(std::string(15, 'a')).version(), 2);
+    QVERIFY(QrCode::encode(std::string(2953, 'a'), QrCode::Ecc::Low).isValid());
+    QVERIFY(!QrCode::encode(std::string(2954, 'a'), QrCode::Ecc::Low).isValid());
+
+    // Automatic mask choice is written into the format bits
+    QrCode automatic = QrCode::encode("https://192.168.1.20:4142");
+    QVERIFY(automatic.mask() >= 0 && automatic.mask() < 8);
+    uint16_t format = QrCode::formatBits(QrCode::Ecc::Medium, automatic.mask());
+    for (int i = 0; i <= 5; ++i) QCOMPARE(automatic.module(8, i), ((format >> i) & 1) != 0);
+}
+
+void TestLocalWaves::testCrc32c() {
+    using Server::Crc32c;
+    // Check value from the CRC catalogue and the RFC 3720 (iSCSI) vectors
+    QCOMPARE(Crc32c::extend(0, "123456789", 9), 0xE3069283u);
+    std::vector<unsigned char> zeros(32, 0x00), ones(32, 0xFF);
+    QCOMPARE(Crc32c::extend(0, zeros.data(), zeros.size()), 0x8A9136AAu);
+    QCOMPARE(Crc32c::extend(0, ones.data(), ones.size()), 0x62A8AB43u);
+
+    // Incremental updates at odd chunk sizes match one pass, hardware or not
+    std::vector<unsigned char> data(100000);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = (unsigned char)(i * 2654435761u >> 13);
+    Crc32c crc;
+    for (size_t offset = 0, step = 1; offset < data.size(); offset += step, step = step * 3 % 1021 + 1) {
+        crc.update(data.data() + offset, std::min(step, data.size() - offset));
+    }
+    QCOMPARE(crc.value(), Crc32c::extendSoftware(0, data.data(), data.size()));
+    QCOMPARE(Crc32c::extend(0, data.data(), data.size()), crc.value());
+
+    uint32_t parsed = 0;
+    QVERIFY(Crc32c::parse("E3069283", parsed));
+    QCOMPARE(parsed, 0xE3069283u);
+    QVERIFY(Crc32c::parse("4waSgw==", parsed)); // Base64, big-endian
+    QCOMPARE(parsed, 0xE3069283u);
+    QVERIFY(!Crc32c::parse("e306928", parsed));
+    QVERIFY(!Crc32c::parse("e306928g", parsed));
+    QCOMPARE(Crc32c::toHex(0x0000ABCDu), std::string("0000abcd"));
+}
+
+void TestLocalWaves::testSrtToVtt() {
+    using Server::SrtToVtt;
+    // Windows-1252 text, CRLF, SRT coordinates, <font> and {\an8} overrides
+    std::string srt = "1\r\n00:00:01,000 --> 00:00:04,074 X1:10 X2:20\r\n<font color=\"red\">Hi</font> {\\an8}<i>there</i>\r\n"
+                      "\r\n\r\n2\r\n0:01:02,5 --> 0:01:03,25\r\nCaf\xe9 \x93ok\x94\r\n";
+    std::string expected = "WEBVTT\n\n1\n00:00:01.000 --> 00:00:04.074\nHi <i>there</i>\n\n"
+                           "2\n00:01:02.500 --> 00:01:03.250\nCaf\xc3\xa9 \xe2\x80\x9cok\xe2\x80\x9d\n";
+    QCOMPARE(SrtToVtt::convert(srt), expected);
+
+    // Same result when fed one byte at a time
+    SrtToVtt streaming;
+    for (char c : srt) streaming.append(&c, 1);
+    QCOMPARE(streaming.finish(), expected);
+
+    // UTF-8 BOM is dropped, valid UTF-8 kept as is; UTF-16 LE is transcoded
+    QCOMPARE(SrtToVtt::convert("\xEF\xBB\xBF" "1\n00:00:00,000 --> 00:00:01,000\nol\xc3\xa1"),
+             std::string("WEBVTT\n\n1\n00:00:00.000 --> 00:00:01.000\nol\xc3\xa1\n"));
+    std::string utf16 = "\xFF\xFE";
+    for (char c : std::string("00:00:05,000 --> 00:00:06,000\nx\n")) utf16 += std::string(1, c) + '\0';
+    QCOMPARE(SrtToVtt::convert(utf16), std::string("WEBVTT\n\n00:00:05.000 --> 00:00:06.000\nx\n"));
+
+    // WebVTT input passes through
+    std::string vtt = "WEBVTT\n\n00:01.000 --> 00:02.000\nx\n";
+    QCOMPARE(SrtToVtt::convert(vtt), vtt);
+}
+
+void TestLocalWaves::testAdmissionReserve() {
+    using Server::AdmissionControl;
+    AdmissionControl admission;
+    AdmissionControl::Limits limits;
+    limits.streams = 2;
+    limits.streamReserve = 1;
+    admission.setLimits(limits);
+
+    // One slot for new streams, the reserved one only for resumed streams
+    AdmissionControl::Ticket first = admission.admit(AdmissionControl::Class::Stream, false);
+    QVERIFY(first);
+    QVERIFY(!admission.admit(AdmissionControl::Class::Stream, false));
+    AdmissionControl::Ticket resumed = admission.admit(AdmissionControl::Class::Stream, true);
+    QVERIFY(resumed);
+    QVERIFY(!admission.admit(AdmissionControl::Class::Stream, true));
+    QCOMPARE(admission.rejected(), (uint64_t)2);
+
+    // Classes are independent; the reserve counts every active stream, so a
+    // new stream needs the resumed one to finish too
+    QVERIFY(admission.admit(AdmissionControl::Class::Listing, false));
+    first = AdmissionControl::Ticket();
+    QVERIFY(admission.admit(AdmissionControl::Class::Stream, true));
+    resumed = AdmissionControl::Ticket();
+    QVERIFY(admission.admit(AdmissionControl::Class::Stream, false));
+}
+
+void TestLocalWaves::testTrafficCaptureRecord() {
+    using Server::TrafficCapture;
+    TrafficCapture::Record record;
+    record.startUs = 1234567;
+    record.connection = 42;
+    record.method = TrafficCapture::Method::Post;
+    record.path = "/upload?name=clip.mp4";
+    record.range = "bytes=-500";
+    record.requestBytes = 5000000000ULL;
+    record.acceptEncoding = "gzip, br";
+    record.ifNoneMatch = "\"c1a2b3c4d-300\"";
+    record.status = 206;
+    record.responseBytes = 300;
+    record.durationUs = 99;
+
+    std::string data;
+    TrafficCapture::encode(record, data);
+    TrafficCapture::encode(TrafficCapture::Record(), data);
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+    TrafficCapture::Record decoded;
+    QVERIFY(TrafficCapture::decode(p, end, decoded));
+    QCOMPARE(decoded.startUs, record.startUs);
+    QCOMPARE(decoded.connection, record.connection);
+    QVERIFY(decoded.method == record.method);
+    QCOMPARE(decoded.path, record.path);
+    QCOMPARE(decoded.range, record.range);
+    QCOMPARE(decoded.requestBytes, record.requestBytes);
+    QCOMPARE(decoded.acceptEncoding, record.acceptEncoding);
+    QCOMPARE(decoded.ifNoneMatch, record.ifNoneMatch);
+    QCOMPARE(decoded.status, record.status);
+    QCOMPARE(decoded.responseBytes, record.responseBytes);
+    QCOMPARE(decoded.durationUs, record.durationUs);
+    QVERIFY(TrafficCapture::decode(p, end, decoded));
+    QVERIFY(decoded.range.empty());
+    QVERIFY(decoded.acceptEncoding.empty());
+    QVERIFY(p == end);
+
+    // A record torn by a crash is not read
+    p = data.data();
+    QVERIFY(!TrafficCapture::decode(p, data.data() + 10, decoded));
+    QVERIFY(p == data.data());
+
+    // Methods without an enum value keep their name
+    TrafficCapture::Record other;
+    other.method = TrafficCapture::methodFromString("PROPFIND");
+    other.otherMethod = "PROPFIND";
+    data.clear();
+    TrafficCapture::encode(other, data);
+    p = data.data();
+    QVERIFY(TrafficCapture::decode(p, data.data() + data.size(), decoded));
+    QCOMPARE(TrafficCapture::methodName(decoded), std::string("PROPFIND"));
+}
+
+void TestLocalWaves::testSessionTokens() {
+    Server::SessionStore sessions;
+    std::string first = sessions.create();
+    std::string second = sessions.create();
+    QCOMPARE(first.size(), (size_t)32);
+    QVERIFY(first != second);
+    QVERIFY(sessions.isValid(first));
+    QVERIFY(sessions.isValid(second));
+    QVERIFY(!sessions.isValid(""));
+    QVERIFY(!sessions.isValid("1"));
+
+    // Only the newest tokens survive a flood of logins
+    for (size_t i = 0; i < Server::SessionStore::kMaxSessions; ++i) sessions.create();
+    QVERIFY(!sessions.isValid(first));
+
+    std::string last = sessions.create();
+    sessions.clear();
+    QVERIFY(!sessions.isValid(last));
+}
+
 QTEST_MAIN(TestLocalWaves)
 #include "TestLocalWaves.moc"
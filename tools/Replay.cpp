@@ -0,0 +1,424 @@
+// localwaves-replay: re-issues a traffic capture (HttpServer::setCaptureFile,
+// LOCALWAVES_CAPTURE in the GUI) against a running server and reports latency.
+//
+// Each captured connection becomes one client thread that sends its requests
+// in order at their recorded offsets (divided by --speed), reusing the socket
+// while the server keeps it alive. The same capture therefore always produces
+// the same request sequence and concurrency, which makes runs comparable
+// across builds and settings. At most --max-connections sessions run at once;
+// finished ones are joined as the replay goes, so a long capture does not
+// accumulate threads.
+
+#include "../src/server/TrafficCapture.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    using SocketType = SOCKET;
+    static const SocketType kInvalidSocket = INVALID_SOCKET;
+#else
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    #include <csignal>
+    using SocketType = int;
+    static const SocketType kInvalidSocket = -1;
+#endif
+
+using Server::TrafficCapture;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string capture;
+    std::string host = "127.0.0.1";
+    std::string cookie;  // Sent with every request, e.g. the session of a password-protected share
+    int port = 4142;
+    double speed = 1.0; // 0: no waiting between requests
+    bool uploads = true;
+    bool print = false;  // List the capture instead of replaying it
+    size_t maxConnections = 512; // Sessions replayed at once; later ones start late
+    std::chrono::seconds timeout{30};
+};
+
+struct Result {
+    int status = 0;          // 0: connection failed
+    int expectedStatus = 0;
+    uint64_t bytes = 0;
+    double firstByteMs = 0;
+    double totalMs = 0;
+    double lateMs = 0;       // Behind schedule when sent
+};
+
+void closeSocket(SocketType socket) {
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+SocketType connectTo(const Options& options) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &addresses) != 0) return kInvalidSocket;
+    SocketType socket = kInvalidSocket;
+    for (addrinfo* address = addresses; address; address = address->ai_next) {
+        socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket == kInvalidSocket) continue;
+        if (connect(socket, address->ai_addr, (int)address->ai_addrlen) == 0) break;
+        closeSocket(socket);
+        socket = kInvalidSocket;
+    }
+    freeaddrinfo(addresses);
+    if (socket != kInvalidSocket) {
+        int one = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    }
+    return socket;
+}
+
+bool sendAll(SocketType socket, const char* data, size_t length) {
+    while (length > 0) {
+        int sent = send(socket, data, (int)std::min(length, (size_t)(1 << 20)), 0);
+        if (sent <= 0) return false;
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+// recv that gives up at the deadline (-1)
+int recvUntil(SocketType socket, char* buffer, int length, Clock::time_point deadline) {
+    auto now = Clock::now();
+    if (now >= deadline) return -1;
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now + std::chrono::microseconds(999)).count();
+    pollfd readable{};
+    readable.fd = socket;
+    readable.events = POLLIN;
+#ifdef _WIN32
+    int ready = WSAPoll(&readable, 1, (int)std::min<long long>(wait, INT_MAX));
+#else
+    int ready = poll(&readable, 1, (int)std::min<long long>(wait, INT_MAX));
+#endif
+    if (ready <= 0) return -1;
+    return recv(socket, buffer, length, 0);
+}
+
+std::string headerValue(const std::string& headers, const char* name) {
+    std::string lower = headers;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    std::string key = std::string("\r\n") + name + ":";
+    size_t pos = lower.find(key);
+    if (pos == std::string::npos) return "";
+    size_t begin = headers.find_first_not_of(' ', pos + key.size());
+    size_t end = headers.find("\r\n", begin);
+    return headers.substr(begin, end - begin);
+}
+
+class Client {
+public:
+    Client(const Options& options) : m_options(options), m_socket(kInvalidSocket) {}
+    ~Client() { disconnect(); }
+
+    Result run(const TrafficCapture::Record& record) {
+        bool reused = m_socket != kInvalidSocket;
+        Result result = attempt(record);
+        // The server may have closed an idle keep-alive socket meanwhile
+        if (reused && result.status == 0) result = attempt(record);
+        return result;
+    }
+
+private:
+    Result attempt(const TrafficCapture::Record& record) {
+        Result result;
+        result.expectedStatus = record.status;
+        if (m_socket == kInvalidSocket) m_socket = connectTo(m_options);
+        if (m_socket == kInvalidSocket) return result;
+
+        std::string request = TrafficCapture::methodName(record) + " " + record.path + " HTTP/1.1\r\n";
+        request += "Host: " + m_options.host + "\r\nUser-Agent: localwaves-replay\r\n";
+        if (!m_options.cookie.empty()) request += "Cookie: " + m_options.cookie + "\r\n";
+        // Recorded validators may be stale against the files served now: those get 200 instead of 304
+        if (!record.acceptEncoding.empty()) request += "Accept-Encoding: " + record.acceptEncoding + "\r\n";
+        if (!record.ifNoneMatch.empty()) request += "If-None-Match: " + record.ifNoneMatch + "\r\n";
+        if (!record.range.empty()) request += "Range: " + record.range + "\r\n";
+        if (record.method == TrafficCapture::Method::Post) request += "Content-Length: " + std::to_string(record.requestBytes) + "\r\n";
+        request += "\r\n";
+
+        auto started = Clock::now();
+        bool ok = sendAll(m_socket, request.data(), request.size());
+        if (ok && record.method == TrafficCapture::Method::Post) {
+            // Bodies are not captured; a zero-filled one of the same size loads the server alike
+            static const std::vector<char> zeros(64 * 1024, 0);
+            for (uint64_t left = record.requestBytes; ok && left > 0;) {
+                size_t chunk = (size_t)std::min<uint64_t>(left, zeros.size());
+                ok = sendAll(m_socket, zeros.data(), chunk);
+                left -= chunk;
+            }
+        }
+        if (!ok || !readResponse(record, started, result)) disconnect();
+        result.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+        return result;
+    }
+
+    void disconnect() {
+        if (m_socket != kInvalidSocket) closeSocket(m_socket);
+        m_socket = kInvalidSocket;
+    }
+
+    // Reads one response; false when the connection cannot be reused
+    bool readResponse(const TrafficCapture::Record& record, Clock::time_point started, Result& result) {
+        char buffer[64 * 1024];
+        Clock::time_point deadline = Clock::now() + m_options.timeout;
+        std::string data;
+        size_t headerEnd;
+        while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+            int n = recvUntil(m_socket, buffer, sizeof(buffer), deadline);
+            if (n <= 0) return false;
+            if (data.empty()) result.firstByteMs = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+            data.append(buffer, n);
+        }
+        result.status = data.size() > 12 ? std::atoi(data.c_str() + 9) : 0;
+        std::string headers = "\r\n" + data.substr(0, headerEnd);
+        uint64_t have = data.size() - headerEnd - 4;
+        bool close = headerValue(headers, "connection") == "close";
+        std::string length = headerValue(headers, "content-length");
+
+        auto receive = [&]() -> int {
+            int n = recvUntil(m_socket, buffer, sizeof(buffer), deadline);
+            if (n > 0) {
+                result.bytes += (uint64_t)n;
+                deadline = Clock::now() + m_options.timeout; // Idle timeout, not total
+            }
+            return n;
+        };
+        result.bytes = data.size();
+
+        if (record.method == TrafficCapture::Method::Head || result.status == 304 || result.status == 204) return !close;
+        if (!length.empty()) {
+            uint64_t want = std::strtoull(length.c_str(), nullptr, 10);
+            while (have < want) {
+                int n = receive();
+                if (n <= 0) return false;
+                have += (uint64_t)n;
+            }
+            return !close;
+        }
+        // Chunked bodies (live follow) end with the server's close; event streams
+        // never do, so those stop after their recorded duration
+        auto recorded = std::chrono::microseconds((uint64_t)(record.durationUs / std::max(m_options.speed, 1e-3)));
+        auto end = started + std::max<Clock::duration>(recorded, std::chrono::milliseconds(100));
+        bool events = headerValue(headers, "content-type") == "text/event-stream";
+        while (true) {
+            if (events) deadline = std::min(deadline, end);
+            if (receive() <= 0) break;
+        }
+        return false;
+    }
+
+    const Options& m_options;
+    SocketType m_socket;
+};
+
+double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0;
+    size_t index = std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void usage() {
+    std::fprintf(stderr,
+        "usage: localwaves-replay CAPTURE [--host HOST] [--port PORT] [--speed X] [--no-uploads] [--timeout SECONDS]\n"
+        "                         [--max-connections N] [--cookie COOKIE]\n"
+        "       localwaves-replay CAPTURE --print\n"
+        "  --speed 1 keeps the recorded timing (default), 2 replays twice as fast, 0 without any waiting\n"
+        "  --max-connections caps the captured connections replayed at once (default 512)\n"
+        "  --cookie is sent with every request; a password-protected share needs the session=... cookie of a login\n"
+        "  --no-uploads skips POST /upload requests, which would write files into the served folder\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) options.host = argv[++i];
+        else if (arg == "--port" && hasValue) options.port = std::atoi(argv[++i]);
+        else if (arg == "--speed" && hasValue) options.speed = std::max(0.0, std::atof(argv[++i]));
+        else if (arg == "--timeout" && hasValue) options.timeout = std::chrono::seconds(std::max(1, std::atoi(argv[++i])));
+        else if (arg == "--max-connections" && hasValue) options.maxConnections = (size_t)std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--cookie" && hasValue) options.cookie = argv[++i];
+        else if (arg == "--no-uploads") options.uploads = false;
+        else if (arg == "--print") options.print = true;
+        else if (arg[0] != '-' && options.capture.empty()) options.capture = arg;
+        else { usage(); return 2; }
+    }
+    if (options.capture.empty()) { usage(); return 2; }
+
+    std::vector<TrafficCapture::Record> records;
+    if (!TrafficCapture::readFile(options.capture, records)) {
+        std::fprintf(stderr, "%s: not a LocalWaves traffic capture (or one from an older version)\n", options.capture.c_str());
+        return 1;
+    }
+    // Records are written when requests finish; replay wants them by start
+    std::stable_sort(records.begin(), records.end(), [](const auto& a, const auto& b) { return a.startUs < b.startUs; });
+    records.erase(std::remove_if(records.begin(), records.end(), [&options](const auto& r) {
+        if (TrafficCapture::methodName(r).empty()) return true; // Nothing to send
+        return !options.uploads && r.method == TrafficCapture::Method::Post && r.path.rfind("/upload", 0) == 0;
+    }), records.end());
+    if (options.print) {
+        std::printf("%12s %6s %-7s %6s %12s %10s  %s\n", "start_ms", "conn", "method", "status", "bytes", "ms", "path [range]");
+        for (const auto& r : records) {
+            std::printf("%12.3f %6llu %-7s %6d %12llu %10.3f  %s", r.startUs / 1000.0, (unsigned long long)r.connection,
+                        TrafficCapture::methodName(r).c_str(), r.status, (unsigned long long)r.responseBytes,
+                        r.durationUs / 1000.0, r.path.c_str());
+            if (!r.range.empty()) std::printf(" [%s]", r.range.c_str());
+            if (r.requestBytes) std::printf(" (%llu bytes sent)", (unsigned long long)r.requestBytes);
+            std::printf("\n");
+        }
+        return 0;
+    }
+    if (records.empty()) {
+        std::fprintf(stderr, "%s: no requests to replay\n", options.capture.c_str());
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#else
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    // One session per captured connection, in order of its first request
+    std::map<uint64_t, std::vector<size_t>> sessions;
+    std::vector<uint64_t> sessionOrder;
+    for (size_t i = 0; i < records.size(); ++i) {
+        auto& session = sessions[records[i].connection];
+        if (session.empty()) sessionOrder.push_back(records[i].connection);
+        session.push_back(i);
+    }
+
+    const uint64_t origin = records.front().startUs;
+    auto scheduled = [&](const TrafficCapture::Record& record, Clock::time_point begin) {
+        if (options.speed == 0) return begin;
+        return begin + std::chrono::microseconds((uint64_t)((record.startUs - origin) / options.speed));
+    };
+
+    std::vector<Result> results(records.size());
+    char speed[32] = "unlimited";
+    if (options.speed != 0) std::snprintf(speed, sizeof(speed), "%gx", options.speed);
+    std::printf("Replaying %zu requests on %zu connections against %s:%d (speed %s)\n", records.size(), sessions.size(),
+                options.host.c_str(), options.port, speed);
+    std::fflush(stdout);
+
+    // Session threads live in reusable slots; a finished session reports its
+    // slot, and the main thread joins it before starting the next session
+    std::mutex sessionMutex;
+    std::condition_variable sessionDone;
+    std::vector<std::thread> workers;
+    std::vector<size_t> finished, freeSlots;
+    size_t running = 0;
+    auto reap = [&] { // With sessionMutex held
+        for (size_t slot : finished) {
+            workers[slot].join();
+            freeSlots.push_back(slot);
+            running--;
+        }
+        finished.clear();
+    };
+
+    auto begin = Clock::now();
+    for (uint64_t id : sessionOrder) {
+        const std::vector<size_t>* session = &sessions[id];
+        std::this_thread::sleep_until(scheduled(records[session->front()], begin));
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(sessionMutex);
+            for (reap(); running >= options.maxConnections; reap()) sessionDone.wait(lock);
+            if (freeSlots.empty()) {
+                slot = workers.size();
+                workers.emplace_back();
+            } else {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            running++;
+        }
+        workers[slot] = std::thread([&, session, slot] {
+            Client client(options);
+            for (size_t index : *session) {
+                auto due = scheduled(records[index], begin);
+                std::this_thread::sleep_until(due);
+                double lateMs = std::chrono::duration<double, std::milli>(Clock::now() - due).count();
+                results[index] = client.run(records[index]);
+                results[index].lateMs = lateMs;
+            }
+            {
+                std::lock_guard<std::mutex> lock(sessionMutex);
+                finished.push_back(slot);
+            }
+            sessionDone.notify_one();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(sessionMutex);
+        for (reap(); running > 0; reap()) sessionDone.wait(lock);
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    std::vector<double> firstByte, total;
+    std::map<int, int> statuses;
+    uint64_t bytes = 0;
+    int failed = 0, mismatched = 0;
+    double maxLate = 0;
+    for (const Result& result : results) {
+        statuses[result.status]++;
+        bytes += result.bytes;
+        maxLate = std::max(maxLate, result.lateMs);
+        if (result.status == 0) { failed++; continue; }
+        if (result.expectedStatus != 0 && result.status != result.expectedStatus) mismatched++;
+        firstByte.push_back(result.firstByteMs);
+        total.push_back(result.totalMs);
+    }
+
+    std::printf("Finished in %.2f s, %.1f MB received (%.1f MB/s), %d failed, %d with a different status than recorded\n",
+                elapsed, bytes / 1e6, bytes / 1e6 / std::max(elapsed, 1e-6), failed, mismatched);
+    std::printf("Status:");
+    for (const auto& [status, count] : statuses) std::printf(" %d=%d", status, count);
+    std::printf("\n");
+    std::printf("First byte ms: p50 %.2f  p95 %.2f  p99 %.2f  max %.2f\n", percentile(firstByte, 0.5),
+                percentile(firstByte, 0.95), percentile(firstByte, 0.99), percentile(firstByte, 1.0));
+    std::printf("Complete ms:   p50 %.2f  p95 %.2f  p99 %.2f  max %.2f\n", percentile(total, 0.5),
+                percentile(total, 0.95), percentile(total, 0.99), percentile(total, 1.0));
+    if (options.speed != 0) std::printf("Worst lag behind schedule: %.2f ms\n", maxLate);
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return failed == 0 ? 0 : 1;
+}